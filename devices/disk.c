@@ -6,7 +6,10 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -28,10 +31,26 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start/stop bus master. */
+#define BM_CMD_READ 0x08        /* 1=device to memory, 0=memory to device. */
+
+/* Bus master Status Register bits. */
+#define BM_ST_ACTIVE 0x01       /* Transfer in progress. */
+#define BM_ST_ERR 0x02          /* Transfer failed.  Write 1 to clear. */
+#define BM_ST_IRQ 0x04          /* Device interrupted.  Write 1 to clear. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +66,14 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Largest number of sectors one command can transfer. */
+#define MAX_XFER_SECTORS 256
 
 /* An ATA device. */
 struct disk {
@@ -56,6 +83,9 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	int multi_cnt;              /* Sectors per interrupt for READ/WRITE
+								   MULTIPLE, 0 if not supported. */
+	bool dma;                   /* True if READ/WRITE DMA are supported. */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
@@ -68,14 +98,45 @@ struct channel {
 	uint16_t reg_base;          /* Base I/O port. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+	uint16_t bm_base;           /* Bus master I/O base, 0 if no DMA. */
+	struct prd *prdt;           /* Physical region descriptor table. */
+
+	/* Request queue, served by the channel's disk thread. */
+	struct lock queue_lock;     /* Protects QUEUE, NEXT_SEQ, and the head. */
+	struct condition queue_ready;   /* Signaled when QUEUE gets a request. */
+	struct list queue;          /* Pending requests, by disk and sector. */
+	uint64_t next_seq;          /* Sequence number of the next request. */
+	int head_dev;               /* Device the last command was for... */
+	disk_sector_t head;         /* ...and the sector it stopped at. */
+
+	/* Current command.  Used only by the disk thread. */
+	struct list active;         /* Requests the current command serves. */
+	struct disk *xfer_disk;     /* Disk the current command is for. */
+	bool xfer_write;            /* True if it writes to the disk. */
+	bool xfer_dma;              /* True if it uses DMA. */
+	size_t xfer_block;          /* PIO sectors per interrupt. */
+	size_t xfer_left;           /* PIO sectors not yet transferred. */
+	struct list_elem *xfer_req; /* PIO request being transferred... */
+	size_t xfer_ofs;            /* ...and sectors of it done so far. */
+
 	struct disk devices[2];     /* The devices on this channel. */
 };
 
+/* A physical region descriptor, one entry of the table the bus
+   master walks during a DMA transfer.  A region must not cross a
+   64 kB boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Byte count, 0 means 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the last entry. */
+};
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_MAX (PGSIZE / sizeof (struct prd))
+
 /* We support the two "legacy" ATA channels found in a standard PC. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
@@ -83,12 +144,16 @@ static struct channel channels[CHANNEL_CNT];
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
+static void set_multiple_mode (struct disk *, int multi_cnt);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
+static uint16_t find_bus_master (void);
+static void channel_thread (void *channel_);
+
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
 static void select_device (const struct disk *);
@@ -99,6 +164,7 @@ static void interrupt_handler (struct intr_frame *);
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = find_bus_master ();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -119,9 +185,22 @@ disk_init (void) {
 			default:
 				NOT_REACHED ();
 		}
-		lock_init (&c->lock);
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		c->bm_base = 0;
+		c->prdt = NULL;
+		if (bm_base != 0) {
+			c->prdt = palloc_get_page (0);
+			if (c->prdt != NULL && vtop (c->prdt) < (1ULL << 32))
+				c->bm_base = bm_base + 8 * chan_no;
+		}
+		lock_init (&c->queue_lock);
+		cond_init (&c->queue_ready);
+		list_init (&c->queue);
+		c->next_seq = 0;
+		c->head_dev = 0;
+		c->head = 0;
+		list_init (&c->active);
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,6 +211,8 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->multi_cnt = 0;
+			d->dma = false;
 
 			d->read_cnt = d->write_cnt = 0;
 		}
@@ -150,6 +231,12 @@ disk_init (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device (&c->devices[dev_no]);
+
+		/* Start the thread that serves the channel's requests.  It
+		   runs at the highest priority so that busy threads cannot
+		   starve the disk; it sleeps whenever it waits for one. */
+		if (thread_create (c->name, PRI_MAX, channel_thread, c) == TID_ERROR)
+			PANIC ("%s: cannot start disk thread", c->name);
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -209,21 +296,7 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	disk_read_multi (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,23 +306,404 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_multi (d, sec_no, 1, buffer);
+}
+
+/* Completion function for synchronous requests. */
+static void
+complete_sync (struct disk_request *req) {
+	sema_up (req->aux);
+}
+
+/* Submits a request to transfer CNT sectors at SEC_NO between disk
+   D and BUFFER and waits for it to complete. */
+static void
+transfer_sync (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer, bool write) {
+	struct disk_request req;
+	struct semaphore done;
+
+	sema_init (&done, 0);
+	req.disk = d;
+	req.sec_no = sec_no;
+	req.cnt = cnt;
+	req.buffer = buffer;
+	req.write = write;
+	req.complete = complete_sync;
+	req.aux = &done;
+	disk_submit (&req);
+	sema_down (&done);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * DISK_SECTOR_SIZE bytes.  CNT must
+   be between 1 and 256.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
+	transfer_sync (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * DISK_SECTOR_SIZE bytes.  CNT must be
+   between 1 and 256.  Returns after the disk has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
+	transfer_sync (d, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Request queue. */
+
+/* Returns true if request A goes before request B in the queue:
+   ordered by device, then by sector.  Requests for the same sector
+   stay in the order they were submitted. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct disk_request *a = list_entry (a_, struct disk_request, elem);
+	const struct disk_request *b = list_entry (b_, struct disk_request, elem);
+
+	if (a->disk->dev_no != b->disk->dev_no)
+		return a->disk->dev_no < b->disk->dev_no;
+	return a->sec_no < b->sec_no;
+}
+
+/* Queues REQ and returns at once.  REQ->COMPLETE is called, from
+   the channel's disk thread, once the transfer is done; REQ and its
+   buffer must stay valid until then.  REQ->CNT must be between 1
+   and 256.  Requests are served in C-LOOK order, except that a
+   request never passes an earlier one for overlapping sectors, and
+   requests for adjacent sectors are merged into a single command. */
+void
+disk_submit (struct disk_request *req) {
 	struct channel *c;
 
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
-
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+	ASSERT (req->disk != NULL);
+	ASSERT (req->buffer != NULL);
+	ASSERT (req->cnt > 0 && req->cnt <= MAX_XFER_SECTORS);
+	ASSERT (req->sec_no + req->cnt <= req->disk->capacity);
+	ASSERT (!intr_context ());
+
+	c = req->disk->channel;
+	lock_acquire (&c->queue_lock);
+	req->seq = c->next_seq++;
+	list_insert_ordered (&c->queue, &req->elem, request_less, NULL);
+	cond_signal (&c->queue_ready, &c->queue_lock);
+	lock_release (&c->queue_lock);
 }
-
+
+/* Returns true if REQ, in channel C's queue, must wait for a request
+   submitted before it that covers some of the same sectors. */
+static bool
+request_blocked (struct channel *c, const struct disk_request *req) {
+	struct list_elem *e;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		if (r->seq < req->seq && r->disk == req->disk
+				&& r->sec_no < req->sec_no + req->cnt
+				&& req->sec_no < r->sec_no + r->cnt)
+			return true;
+	}
+	return false;
+}
+
+/* Returns the first request in channel C's queue at or after the
+   head, C-LOOK style: after the last request, wraps around to the
+   first.  Requests blocked by earlier overlapping ones are passed
+   over; the oldest request is never blocked, so one is always
+   found. */
+static struct list_elem *
+channel_next (struct channel *c) {
+	struct list_elem *e, *first = NULL;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct disk_request *req = list_entry (e, struct disk_request, elem);
+		if (request_blocked (c, req))
+			continue;
+		if (req->disk->dev_no > c->head_dev
+				|| (req->disk->dev_no == c->head_dev && req->sec_no >= c->head))
+			return e;
+		if (first == NULL)
+			first = e;
+	}
+	ASSERT (first != NULL);
+	return first;
+}
+
+/* Adds the SIZE bytes at BUFFER to channel C's PRD table, starting
+   at entry *PRD_CNT and advancing it.  Returns false if BUFFER
+   cannot be reached by DMA: it must be kernel memory below 4 GB. */
+static bool
+build_prdt (struct channel *c, size_t *prd_cnt, void *buffer, size_t size) {
+	uint64_t pa, end;
+
+	if (!is_kernel_vaddr (buffer) || ((uintptr_t) buffer & 1))
+		return false;
+	pa = vtop (buffer);
+	end = pa + size;
+	if (end > (1ULL << 32))
+		return false;
+
+	while (pa < end) {
+		/* Stop at the next 64 kB boundary. */
+		uint64_t next = (pa + 0x10000) & ~(uint64_t) 0xffff;
+		if (next > end)
+			next = end;
+		if (*prd_cnt == PRD_MAX)
+			return false;
+		c->prdt[*prd_cnt].addr = pa;
+		c->prdt[*prd_cnt].size = next - pa;     /* 64 kB wraps to 0. */
+		c->prdt[*prd_cnt].flags = 0;
+		pa = next;
+		++*prd_cnt;
+	}
+	return true;
+}
+
+/* Returns true if every request of channel C's current command can
+   be transferred by DMA, filling in the PRD table if so. */
+static bool
+channel_setup_dma (struct channel *c) {
+	size_t prd_cnt = 0;
+	struct list_elem *e;
+
+	if (c->bm_base == 0 || !c->xfer_disk->dma)
+		return false;
+	for (e = list_begin (&c->active); e != list_end (&c->active);
+			e = list_next (e)) {
+		struct disk_request *req = list_entry (e, struct disk_request, elem);
+		if (!build_prdt (c, &prd_cnt, req->buffer,
+					req->cnt * DISK_SECTOR_SIZE))
+			return false;
+	}
+	c->prdt[prd_cnt - 1].flags = PRD_EOT;
+	return true;
+}
+
+/* Moves the next block of the current PIO command of channel C
+   between the data register and the requests' buffers. */
+static void
+channel_pio_block (struct channel *c) {
+	size_t n = c->xfer_left < c->xfer_block ? c->xfer_left : c->xfer_block;
+
+	for (c->xfer_left -= n; n > 0; n--) {
+		struct disk_request *req =
+			list_entry (c->xfer_req, struct disk_request, elem);
+		uint8_t *sector = (uint8_t *) req->buffer
+			+ c->xfer_ofs * DISK_SECTOR_SIZE;
+
+		if (c->xfer_write)
+			output_sector (c, sector);
+		else
+			input_sector (c, sector);
+		if (++c->xfer_ofs == req->cnt) {
+			c->xfer_req = list_next (c->xfer_req);
+			c->xfer_ofs = 0;
+		}
+	}
+}
+
+/* Moves the next requests in channel C's queue to its active list,
+   taking the next request and then any requests that continue it on
+   the same disk in the same direction.  Returns the number of
+   sectors they cover.  C's queue lock must be held and its queue
+   must not be empty. */
+static size_t
+channel_take (struct channel *c) {
+	struct disk_request *first, *last;
+	struct list_elem *e;
+	size_t cnt;
+
+	ASSERT (lock_held_by_current_thread (&c->queue_lock));
+	ASSERT (!list_empty (&c->queue));
+
+	e = channel_next (c);
+	first = last = list_entry (e, struct disk_request, elem);
+	cnt = first->cnt;
+	for (;;) {
+		struct list_elem *next = list_next (e);
+		list_remove (e);
+		list_push_back (&c->active, e);
+		if (next == list_end (&c->queue))
+			break;
+
+		struct disk_request *req = list_entry (next, struct disk_request, elem);
+		if (req->disk != first->disk || req->write != first->write
+				|| req->sec_no != last->sec_no + last->cnt
+				|| cnt + req->cnt > MAX_XFER_SECTORS
+				|| request_blocked (c, req))
+			break;
+		e = next;
+		last = req;
+		cnt += req->cnt;
+	}
+
+	c->xfer_disk = first->disk;
+	c->xfer_write = first->write;
+	c->head_dev = first->disk->dev_no;
+	c->head = first->sec_no + cnt;
+	return cnt;
+}
+
+/* Carries out channel C's current command, which covers CNT
+   sectors, sleeping while the disk works. */
+static void
+channel_transfer (struct channel *c, size_t cnt) {
+	struct disk *d = c->xfer_disk;
+	disk_sector_t sec_no =
+		list_entry (list_front (&c->active), struct disk_request, elem)->sec_no;
+	uint8_t command;
+
+	c->xfer_dma = channel_setup_dma (c);
+	if (c->xfer_dma) {
+		outl (reg_bm_prdt (c), vtop (c->prdt));
+		outb (reg_bm_command (c), c->xfer_write ? 0 : BM_CMD_READ);
+		outb (reg_bm_status (c), BM_ST_ERR | BM_ST_IRQ);
+		command = c->xfer_write ? CMD_WRITE_DMA : CMD_READ_DMA;
+	} else if (cnt > 1 && d->multi_cnt > 0) {
+		c->xfer_block = d->multi_cnt;
+		command = c->xfer_write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+	} else {
+		c->xfer_block = 1;
+		command = c->xfer_write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+	}
+	c->xfer_left = cnt;
+	c->xfer_req = list_begin (&c->active);
+	c->xfer_ofs = 0;
+
+	select_sector (d, sec_no, cnt);
+	issue_pio_command (c, command);
+	if (c->xfer_dma) {
+		uint8_t bm_status;
+
+		outb (reg_bm_command (c),
+				(c->xfer_write ? 0 : BM_CMD_READ) | BM_CMD_START);
+		sema_down (&c->completion_wait);
+		outb (reg_bm_command (c), 0);
+		bm_status = inb (reg_bm_status (c));
+		outb (reg_bm_status (c), BM_ST_ERR | BM_ST_IRQ);
+		if ((bm_status & BM_ST_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+			PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+					c->xfer_write ? "write" : "read", sec_no);
+	} else if (!c->xfer_write) {
+		/* Each interrupt announces a block of data to read. */
+		while (c->xfer_left > 0) {
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+			channel_pio_block (c);
+		}
+	} else {
+		/* The disk asks for each block of a write with DRQ, and
+		   acknowledges it with an interrupt. */
+		while (c->xfer_left > 0) {
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+			channel_pio_block (c);
+			sema_down (&c->completion_wait);
+		}
+	}
+}
+
+/* Completes channel C's current command's requests. */
+static void
+channel_finish (struct channel *c) {
+	struct disk *d = c->xfer_disk;
+
+	while (!list_empty (&c->active)) {
+		struct disk_request *req =
+			list_entry (list_pop_front (&c->active), struct disk_request, elem);
+
+		if (req->write)
+			d->write_cnt += req->cnt;
+		else
+			d->read_cnt += req->cnt;
+		req->complete (req);
+	}
+}
+
+/* Disk thread for channel C.  Serves its queued requests one
+   command at a time.  Doing the transfers here rather than in the
+   interrupt handler lets waits for the disk sleep and keeps
+   interrupts on while PIO data is copied. */
+static void
+channel_thread (void *channel_) {
+	struct channel *c = channel_;
+
+	for (;;) {
+		size_t cnt;
+
+		lock_acquire (&c->queue_lock);
+		while (list_empty (&c->queue))
+			cond_wait (&c->queue_ready, &c->queue_lock);
+		cnt = channel_take (c);
+		lock_release (&c->queue_lock);
+
+		channel_transfer (c, cnt);
+		channel_finish (c);
+	}
+}
+
+/* Bus master DMA. */
+
+/* Reads 32-bit register REG of PCI function BUS:DEV.FUNC. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg) {
+	outl (0xcf8, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8)
+			| (reg & 0xfc));
+	return inl (0xcfc);
+}
+
+/* Writes 32-bit register REG of PCI function BUS:DEV.FUNC. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value) {
+	outl (0xcf8, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8)
+			| (reg & 0xfc));
+	outl (0xcfc, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can do bus master
+   DMA, such as the PIIX that QEMU emulates, and turns bus mastering
+   on.  Returns the I/O base of its bus master registers, or 0 if
+   there is none. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class, bar4, command;
+
+			if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+				continue;
+
+			/* Mass storage, IDE, bus master capable. */
+			class = pci_read_config (0, dev, func, 0x08);
+			if ((class >> 16) != 0x0101 || !(class & 0x8000))
+				continue;
+
+			bar4 = pci_read_config (0, dev, func, 0x20);
+			if (!(bar4 & 1) || (bar4 & 0xfff0) == 0)
+				continue;
+
+			/* Enable I/O space and bus mastering, leaving the
+			   write-1-to-clear status half alone. */
+			command = pci_read_config (0, dev, func, 0x04) & 0xffff;
+			pci_write_config (0, dev, func, 0x04, command | 0x05);
+			return bar4 & 0xfff0;
+		}
+	return 0;
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -364,6 +818,14 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Turn on READ/WRITE MULTIPLE with the largest block size the
+	   disk supports, if any. */
+	if ((id[47] & 0xff) > 0)
+		set_multiple_mode (d, id[47] & 0xff);
+
+	/* DMA support (word 49, bit 8). */
+	d->dma = (id[49] & 0x0100) != 0;
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -382,6 +844,22 @@ identify_ata_device (struct disk *d) {
 	printf ("\"\n");
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D, asking for
+   MULTI_CNT sectors per interrupt in READ/WRITE MULTIPLE, and sets
+   D's multi_cnt member to MULTI_CNT if the disk accepts. */
+static void
+set_multiple_mode (struct disk *d, int multi_cnt) {
+	struct channel *c = d->channel;
+
+	select_device_wait (d);
+	outb (reg_nsect (c), multi_cnt);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	wait_while_busy (d);
+	if ((inb (reg_status (c)) & STA_ERR) == 0)
+		d->multi_cnt = multi_cnt;
+}
+
 /* Prints STRING, which consists of SIZE bytes in a funky format:
    each pair of bytes is in reverse order.  Does not print
    trailing whitespace and/or nulls. */
@@ -402,17 +880,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the count CNT of sectors to transfer to the
+   disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= MAX_XFER_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt % MAX_XFER_SECTORS);   /* 0 means 256. */
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
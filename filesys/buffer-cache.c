@@ -0,0 +1,457 @@
+#include "filesys/buffer-cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of sectors cached. */
+#define CACHE_CNT 64
+
+/* The flush thread wakes up every FLUSH_INTERVAL ticks and writes back
+ * sectors that have been dirty for at least FLUSH_AGE ticks. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+#define FLUSH_AGE (30 * TIMER_FREQ)
+
+/* A cached sector. */
+struct cache_entry {
+	/* Protected by cache_lock. */
+	disk_sector_t sector;               /* Sector held. */
+	bool in_use;                        /* True if SECTOR is meaningful. */
+	bool accessed;                      /* Used since the clock last passed. */
+	int pin_cnt;                        /* Threads using or waiting for it. */
+
+	/* Changed by a transaction that has not committed yet, so must not
+	 * be written back.  Both locks are held to change it. */
+	bool held;
+
+	/* Protected by LOCK. */
+	struct lock lock;                   /* Held while DATA is in use. */
+	bool valid;                         /* True once DATA holds SECTOR. */
+	bool dirty;                         /* True if DATA differs from disk. */
+	int64_t dirty_since;                /* Tick DATA became dirty. */
+	bool reading;                       /* Prefetch read outstanding. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+
+	/* Prefetch read into DATA, and its completion. */
+	struct disk_request req;
+	struct semaphore read_done;
+};
+
+static struct cache_entry cache[CACHE_CNT];
+static size_t clock_hand;               /* Next entry the clock looks at. */
+static struct lock cache_lock;          /* Protects sector mapping. */
+static struct condition cache_unpinned; /* Signaled when an entry is free. */
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups found in the cache. */
+static long long miss_cnt;              /* Lookups that read the disk. */
+static long long writeback_cnt;         /* Dirty sectors written back. */
+static long long prefetch_cnt;          /* Sectors read ahead. */
+static long long direct_cnt;            /* Sectors read around the cache. */
+
+static void flushd (void *aux);
+
+/* Initializes the buffer cache and starts its flush thread. */
+void
+buffer_cache_init (void) {
+	size_t i;
+
+	lock_init (&cache_lock);
+	cond_init (&cache_unpinned);
+	for (i = 0; i < CACHE_CNT; i++) {
+		cache[i].in_use = false;
+		cache[i].pin_cnt = 0;
+		cache[i].held = false;
+		lock_init (&cache[i].lock);
+		cache[i].valid = false;
+		cache[i].dirty = false;
+		cache[i].reading = false;
+		sema_init (&cache[i].read_done, 0);
+	}
+	clock_hand = 0;
+
+	if (thread_create ("flushd", PRI_DEFAULT, flushd, NULL) == TID_ERROR)
+		PANIC ("buffer cache: cannot start flushd");
+}
+
+/* Writes E back to disk if it is dirty.  E's lock must be held. */
+static void
+entry_writeback (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&e->lock));
+	ASSERT (!e->held);
+
+	if (e->valid && e->dirty) {
+		disk_write (filesys_disk, e->sector, e->data);
+		e->dirty = false;
+		writeback_cnt++;
+	}
+}
+
+/* Waits for a prefetch read into E to complete, if one is outstanding.
+ * E's lock must be held. */
+static void
+entry_wait_read (struct cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&e->lock));
+
+	if (e->reading) {
+		sema_down (&e->read_done);
+		e->reading = false;
+		e->valid = true;
+	}
+}
+
+/* Returns the entry for SECTOR, or a null pointer if SECTOR is not
+ * cached.  CACHE_LOCK must be held. */
+static struct cache_entry *
+cache_lookup (disk_sector_t sector) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (i = 0; i < CACHE_CNT; i++)
+		if (cache[i].in_use && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Picks an unpinned entry to reuse with the clock algorithm, passing
+ * over held ones.  If there is none, waits for one if WAIT is true,
+ * otherwise returns a null pointer.  CACHE_LOCK must be held. */
+static struct cache_entry *
+cache_victim (bool wait) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (;;) {
+		size_t scan;
+
+		for (scan = 0; scan < 2 * CACHE_CNT; scan++) {
+			struct cache_entry *e = &cache[clock_hand];
+
+			clock_hand = (clock_hand + 1) % CACHE_CNT;
+			if (e->pin_cnt > 0 || e->held)
+				continue;
+			if (e->in_use && e->accessed) {
+				e->accessed = false;
+				continue;
+			}
+			return e;
+		}
+		if (!wait)
+			return NULL;
+		cond_wait (&cache_unpinned, &cache_lock);
+	}
+}
+
+/* Picks a victim with cache_victim(WAIT) and reassigns it to SECTOR.
+ * The victim is pinned while its old contents are written back with
+ * CACHE_LOCK released, so that the disk write does not stall every other
+ * user of the cache.  The old contents reach the disk before the new
+ * sector becomes visible, so that a reader of the old sector can never
+ * see stale disk data.
+ *
+ * Returns the victim, pinned once, with its lock held and DATA not yet
+ * valid.  Returns a null pointer if there is no victim and WAIT is
+ * false, or if another thread wanted the victim's old sector or cached
+ * SECTOR meanwhile; the caller should then look SECTOR up again.
+ * CACHE_LOCK must be held on entry and is held on return. */
+static struct cache_entry *
+cache_evict (disk_sector_t sector, bool wait) {
+	struct cache_entry *e;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	e = cache_victim (wait);
+	if (e == NULL)
+		return NULL;
+	e->pin_cnt++;
+	lock_release (&cache_lock);
+
+	lock_acquire (&e->lock);
+	entry_wait_read (e);
+	entry_writeback (e);
+
+	/* Nobody else can dirty E without pinning it, so E is still clean
+	 * if we are its only user. */
+	lock_acquire (&cache_lock);
+	if (e->pin_cnt > 1 || cache_lookup (sector) != NULL) {
+		lock_release (&e->lock);
+		if (--e->pin_cnt == 0)
+			cond_signal (&cache_unpinned, &cache_lock);
+		return NULL;
+	}
+	e->sector = sector;
+	e->in_use = true;
+	e->valid = false;
+	return e;
+}
+
+/* Returns the entry for SECTOR with its lock held, reading it from disk
+ * unless FULL_WRITE says the caller is about to overwrite all of it. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool full_write) {
+	struct cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	for (;;) {
+		e = cache_lookup (sector);
+		if (e != NULL) {
+			hit_cnt++;
+			e->pin_cnt++;
+			e->accessed = true;
+			lock_release (&cache_lock);
+			lock_acquire (&e->lock);
+			entry_wait_read (e);
+			break;
+		}
+
+		e = cache_evict (sector, true);
+		if (e != NULL) {
+			miss_cnt++;
+			e->accessed = true;
+			lock_release (&cache_lock);
+			break;
+		}
+	}
+
+	if (!e->valid) {
+		if (!full_write)
+			disk_read (filesys_disk, sector, e->data);
+		e->valid = true;
+	}
+	return e;
+}
+
+/* Releases entry E obtained from cache_get(), marking it dirty if DIRTY
+ * is true. */
+static void
+cache_put (struct cache_entry *e, bool dirty) {
+	if (dirty && !e->dirty) {
+		e->dirty = true;
+		e->dirty_since = timer_ticks ();
+	}
+	lock_release (&e->lock);
+
+	lock_acquire (&cache_lock);
+	if (--e->pin_cnt == 0)
+		cond_signal (&cache_unpinned, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+ * DISK_SECTOR_SIZE bytes. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer) {
+	buffer_cache_read_at (sector, buffer, 0, DISK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR from BUFFER, which must contain
+ * DISK_SECTOR_SIZE bytes. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer) {
+	buffer_cache_write_at (sector, buffer, 0, DISK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS of sector SECTOR into BUFFER. */
+void
+buffer_cache_read_at (disk_sector_t sector, void *buffer, size_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, false);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e, false);
+}
+
+/* Returns true if SECTOR is in the cache. */
+static bool
+cache_contains (disk_sector_t sector) {
+	bool found;
+
+	lock_acquire (&cache_lock);
+	found = cache_lookup (sector) != NULL;
+	lock_release (&cache_lock);
+	return found;
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER.  Sectors that
+ * are cached are read from the cache, so that dirty data is seen; runs
+ * of the others are read straight from disk, several sectors per
+ * request, and are not cached.  This suits data that is read once, such
+ * as the source of a copy, which would otherwise push everything else
+ * out of the cache.  A sector that leaves the cache is written back
+ * first, so one found missing is up to date on disk. */
+void
+buffer_cache_read_multi (disk_sector_t sector, size_t cnt, void *buffer) {
+	uint8_t *p = buffer;
+
+	while (cnt > 0) {
+		size_t run;
+
+		if (cache_contains (sector)) {
+			buffer_cache_read (sector, p);
+			run = 1;
+		} else {
+			for (run = 1; run < cnt && !cache_contains (sector + run); run++)
+				continue;
+			disk_read_multi (filesys_disk, sector, run, p);
+			direct_cnt += run;
+		}
+		sector += run;
+		cnt -= run;
+		p += run * DISK_SECTOR_SIZE;
+	}
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of sector SECTOR.
+ * The sector reaches the disk later, when it is evicted or flushed. */
+void
+buffer_cache_write_at (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size == DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	cache_put (e, true);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of sector SECTOR,
+ * like buffer_cache_write_at(), and holds the sector in the cache
+ * without writing it back until buffer_cache_release() is called. */
+void
+buffer_cache_write_held (disk_sector_t sector, const void *buffer,
+		size_t ofs, size_t size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+	e = cache_get (sector, size == DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	lock_acquire (&cache_lock);
+	e->held = true;
+	lock_release (&cache_lock);
+	cache_put (e, true);
+}
+
+/* Writes held sector SECTOR back to disk and lets it be written back
+ * like any other again. */
+void
+buffer_cache_release (disk_sector_t sector) {
+	struct cache_entry *e = cache_get (sector, false);
+
+	ASSERT (e->held);
+	lock_acquire (&cache_lock);
+	e->held = false;
+	lock_release (&cache_lock);
+	entry_writeback (e);
+	cache_put (e, false);
+}
+
+/* Completes a prefetch read.  Runs in the disk's channel thread. */
+static void
+prefetch_done (struct disk_request *req) {
+	struct cache_entry *e = req->aux;
+	sema_up (&e->read_done);
+}
+
+/* Starts reading sector SECTOR into the cache in the background, unless
+ * it is already cached.  Gives up rather than wait if every entry is in
+ * use.  Prefetches of adjacent sectors are merged by the disk queue. */
+void
+buffer_cache_prefetch (disk_sector_t sector) {
+	struct cache_entry *e = NULL;
+
+	lock_acquire (&cache_lock);
+	if (cache_lookup (sector) == NULL)
+		e = cache_evict (sector, false);
+	if (e == NULL) {
+		lock_release (&cache_lock);
+		return;
+	}
+	prefetch_cnt++;
+	e->accessed = false;
+	e->reading = true;
+	if (--e->pin_cnt == 0)
+		cond_signal (&cache_unpinned, &cache_lock);
+	lock_release (&cache_lock);
+	lock_release (&e->lock);
+
+	e->req.disk = filesys_disk;
+	e->req.sec_no = sector;
+	e->req.cnt = 1;
+	e->req.buffer = e->data;
+	e->req.write = false;
+	e->req.complete = prefetch_done;
+	e->req.aux = e;
+	disk_submit (&e->req);
+}
+
+/* Writes back dirty sectors numbered FIRST through LAST that became
+ * dirty at or before tick OLDEST. */
+static void
+cache_flush_older (int64_t oldest, disk_sector_t first, disk_sector_t last) {
+	size_t i;
+
+	for (i = 0; i < CACHE_CNT; i++) {
+		struct cache_entry *e = &cache[i];
+
+		lock_acquire (&cache_lock);
+		if (!e->in_use || e->sector < first || e->sector > last) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		e->pin_cnt++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&e->lock);
+		if (e->dirty && !e->held && e->dirty_since <= oldest)
+			entry_writeback (e);
+		cache_put (e, false);
+	}
+}
+
+/* Writes every dirty sector that is not held back to disk. */
+void
+buffer_cache_flush (void) {
+	cache_flush_older (INT64_MAX, 0, UINT32_MAX);
+}
+
+/* Writes the dirty sectors among the CNT starting at SECTOR that are not
+ * held back to disk. */
+void
+buffer_cache_flush_range (disk_sector_t sector, size_t cnt) {
+	if (cnt > 0)
+		cache_flush_older (INT64_MAX, sector, sector + cnt - 1);
+}
+
+/* Flush thread.  Writes back sectors that have stayed dirty for a
+ * while, so that a crash loses little and eviction rarely has to write.
+ * Also moves delayed file data into the cache, since the inode layer
+ * defers writing it, and commits the metadata changes made meanwhile as
+ * one journal transaction. */
+static void
+flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		inode_flush_delayed_all ();
+		journal_commit ();
+		cache_flush_older (timer_ticks () - FLUSH_AGE, 0, UINT32_MAX);
+	}
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	printf ("Buffer cache: %lld hits, %lld misses, %lld writebacks, "
+			"%lld prefetches, %lld direct reads\n", hit_cnt, miss_cnt,
+			writeback_cnt, prefetch_cnt, direct_cnt);
+}
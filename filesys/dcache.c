@@ -0,0 +1,137 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of cached names. */
+#define DCACHE_CNT 128
+
+/* A cached directory entry. */
+struct dentry {
+	struct hash_elem hash_elem;         /* Element in DENTRIES. */
+	struct list_elem lru_elem;          /* Element in LRU. */
+	disk_sector_t dir;                  /* Directory's inode sector. */
+	char name[NAME_MAX + 1];            /* Name within DIR. */
+	disk_sector_t sector;               /* Inode sector, or DCACHE_NONE. */
+};
+
+static struct hash dentries;            /* All cached entries. */
+static struct list lru;                 /* Least recently used first. */
+static size_t dentry_cnt;               /* Number of cached entries. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups answered from the cache. */
+static long long miss_cnt;              /* Lookups left to the directory. */
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory lookup cache. */
+void
+dcache_init (void) {
+	if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+		PANIC ("dentry cache creation failed");
+	list_init (&lru);
+	dentry_cnt = 0;
+	lock_init (&dcache_lock);
+}
+
+/* Returns the cached entry for NAME in directory DIR, or a null pointer.
+ * DCACHE_LOCK must be held. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is at sector DIR.  If the
+ * answer is cached, returns true and stores the inode sector NAME refers
+ * to, or DCACHE_NONE if NAME does not exist, into *SECTORP.  Otherwise
+ * returns false. */
+bool
+dcache_lookup (disk_sector_t dir, const char *name, disk_sector_t *sectorp) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_back (&lru, &d->lru_elem);
+		*sectorp = d->sector;
+		hit_cnt++;
+	} else
+		miss_cnt++;
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is at sector DIR
+ * refers to the inode at SECTOR, or does not exist if SECTOR is
+ * DCACHE_NONE.  Directories call this whenever they look up, add or
+ * remove a name, so that the cache never goes stale. */
+void
+dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		if (dentry_cnt >= DCACHE_CNT) {
+			/* Reuse the least recently used entry. */
+			d = list_entry (list_pop_front (&lru), struct dentry, lru_elem);
+			hash_delete (&dentries, &d->hash_elem);
+		} else {
+			d = malloc (sizeof *d);
+			if (d == NULL) {
+				lock_release (&dcache_lock);
+				return;
+			}
+			dentry_cnt++;
+		}
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->hash_elem);
+	}
+	d->sector = sector;
+	list_push_back (&lru, &d->lru_elem);
+	lock_release (&dcache_lock);
+}
+
+/* Prints directory lookup cache statistics. */
+void
+dcache_print_stats (void) {
+	printf ("Dentry cache: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
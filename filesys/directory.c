@@ -1,9 +1,13 @@
 #include "filesys/directory.h"
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -19,6 +23,18 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Large directories are hashed.  Entry 0 of a hashed directory is a
+ * header: a free entry whose name is DIR_INDEX_MAGIC and whose
+ * inode_sector holds the number of buckets.  The entries after it form
+ * the buckets, DIR_BUCKET_SLOTS entries each, and each name lives in the
+ * bucket picked by its hash.  Since a hashed directory is still an array
+ * of entries, dir_readdir() needs no special case.  A directory becomes
+ * hashed once it holds DIR_INDEX_THRESHOLD entries and has no free slot
+ * left; a full bucket doubles the number of buckets. */
+#define DIR_INDEX_MAGIC "\177hashed-dir"
+#define DIR_BUCKET_SLOTS 25
+#define DIR_INDEX_THRESHOLD 64
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -27,11 +43,13 @@ dir_create (disk_sector_t sector, size_t entry_cnt) {
 }
 
 /* Opens and returns the directory for the given INODE, of which
- * it takes ownership.  Returns a null pointer on failure. */
+ * it takes ownership.  Directory contents are metadata, so they are
+ * written through the journal.  Returns a null pointer on failure. */
 struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
+		inode_set_metadata (inode);
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
@@ -71,20 +89,73 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Returns the number of buckets of DIR, or 0 if DIR is not hashed. */
+static size_t
+dir_bucket_cnt (const struct dir *dir) {
+	struct dir_entry e;
+
+	if (inode_read_at (dir->inode, &e, sizeof e, 0) != sizeof e
+			|| e.in_use || strcmp (e.name, DIR_INDEX_MAGIC))
+		return 0;
+	return e.inode_sector;
+}
+
+/* Returns the byte offset of the bucket for NAME in a directory with
+ * BUCKET_CNT buckets. */
+static off_t
+bucket_ofs (const char *name, size_t bucket_cnt) {
+	size_t bucket = hash_string (name) % bucket_cnt;
+	return (1 + bucket * DIR_BUCKET_SLOTS) * sizeof (struct dir_entry);
+}
+
+/* Reads the bucket at byte offset OFS of DIR into BUCKET, which must
+ * have room for DIR_BUCKET_SLOTS entries. */
+static void
+read_bucket (const struct dir *dir, off_t ofs, struct dir_entry *bucket) {
+	off_t size = DIR_BUCKET_SLOTS * sizeof *bucket;
+	off_t got = inode_read_at (dir->inode, bucket, size, ofs);
+
+	memset ((uint8_t *) bucket + got, 0, size - got);
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * A hashed directory only has NAME's bucket searched. */
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
 	struct dir_entry e;
-	size_t ofs;
+	size_t ofs, bucket_cnt;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	bucket_cnt = dir_bucket_cnt (dir);
+	if (bucket_cnt > 0) {
+		struct dir_entry *bucket = malloc (DIR_BUCKET_SLOTS * sizeof *bucket);
+		bool found = false;
+		size_t i;
+
+		if (bucket == NULL)
+			return false;
+		ofs = bucket_ofs (name, bucket_cnt);
+		read_bucket (dir, ofs, bucket);
+		for (i = 0; i < DIR_BUCKET_SLOTS; i++)
+			if (bucket[i].in_use && !strcmp (name, bucket[i].name)) {
+				if (ep != NULL)
+					*ep = bucket[i];
+				if (ofsp != NULL)
+					*ofsp = ofs + i * sizeof e;
+				found = true;
+				break;
+			}
+		free (bucket);
+		return found;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -97,6 +168,96 @@ lookup (const struct dir *dir, const char *name,
 	return false;
 }
 
+/* Rewrites DIR, hashed or not, as a hashed directory of BUCKET_CNT
+ * buckets.  Returns false if an entry does not fit in its bucket, if
+ * the running journal transaction has no room for the rewrite, or on
+ * memory or disk errors, in which case DIR is unchanged. */
+static bool
+dir_rehash (struct dir *dir, size_t bucket_cnt) {
+	off_t length = inode_length (dir->inode);
+	size_t slot_cnt = 1 + bucket_cnt * DIR_BUCKET_SLOTS;
+	size_t old_cnt = length / sizeof (struct dir_entry);
+	struct dir_entry *old, *new;
+	off_t new_size;
+	bool success = false;
+	size_t i;
+
+	if (slot_cnt < old_cnt)
+		slot_cnt = old_cnt;
+	new_size = slot_cnt * sizeof *new;
+
+	/* The whole directory is rewritten by one journaled operation, along
+	 * with its inode and indirect block. */
+	if (!journal_extend (DIV_ROUND_UP (new_size, DISK_SECTOR_SIZE) + 2))
+		return false;
+	old = malloc (length);
+	new = calloc (slot_cnt, sizeof *new);
+	if (old == NULL || new == NULL)
+		goto done;
+	if (inode_read_at (dir->inode, old, length, 0) != length)
+		goto done;
+
+	strlcpy (new[0].name, DIR_INDEX_MAGIC, sizeof new[0].name);
+	new[0].inode_sector = bucket_cnt;
+	for (i = 0; i < old_cnt; i++) {
+		struct dir_entry *bucket;
+		size_t j;
+
+		if (!old[i].in_use)
+			continue;
+		bucket = new + bucket_ofs (old[i].name, bucket_cnt) / sizeof *new;
+		for (j = 0; j < DIR_BUCKET_SLOTS && bucket[j].in_use; j++)
+			continue;
+		if (j == DIR_BUCKET_SLOTS)
+			goto done;
+		bucket[j] = old[i];
+	}
+
+	/* Slots past the buckets, left from a longer unhashed directory,
+	 * are written out free. */
+	success = inode_write_at (dir->inode, new, new_size, 0) == new_size;
+
+done:
+	free (old);
+	free (new);
+	return success;
+}
+
+/* Adds the entry E to hashed directory DIR, which has BUCKET_CNT
+ * buckets, doubling the buckets as long as E's bucket is full.  Returns
+ * true if successful, false on failure. */
+static bool
+dir_add_hashed (struct dir *dir, struct dir_entry *e, size_t bucket_cnt) {
+	struct dir_entry *bucket = malloc (DIR_BUCKET_SLOTS * sizeof *bucket);
+	bool success = false;
+
+	if (bucket == NULL)
+		return false;
+	for (;;) {
+		off_t ofs = bucket_ofs (e->name, bucket_cnt);
+		size_t i;
+
+		read_bucket (dir, ofs, bucket);
+		for (i = 0; i < DIR_BUCKET_SLOTS; i++)
+			if (!bucket[i].in_use) {
+				ofs += i * sizeof *e;
+				success = inode_write_at (dir->inode, e, sizeof *e, ofs)
+					== sizeof *e;
+				goto done;
+			}
+
+		do
+			bucket_cnt *= 2;
+		while (!dir_rehash (dir, bucket_cnt) && bucket_cnt < 4096);
+		if (dir_bucket_cnt (dir) != bucket_cnt)
+			goto done;
+	}
+
+done:
+	free (bucket);
+	return success;
+}
+
 /* Searches DIR for a file with the given NAME
  * and returns true if one exists, false otherwise.
  * On success, sets *INODE to an inode for the file, otherwise to
@@ -104,13 +265,20 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector, sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
+	dir_sector = inode_get_inumber (dir->inode);
+	if (!dcache_lookup (dir_sector, name, &sector)) {
+		sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NONE;
+		dcache_insert (dir_sector, name, sector);
+	}
+
+	if (sector != DCACHE_NONE)
+		*inode = inode_open (sector);
 	else
 		*inode = NULL;
 
@@ -125,21 +293,37 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
-	struct dir_entry e;
+	disk_sector_t dir_sector, cached;
+	struct dir_entry e, slot;
+	size_t bucket_cnt;
 	off_t ofs;
 	bool success = false;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
+	dir_sector = inode_get_inumber (dir->inode);
 
 	/* Check NAME for validity. */
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
 	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	if (dcache_lookup (dir_sector, name, &cached)) {
+		if (cached != DCACHE_NONE)
+			goto done;
+	} else if (lookup (dir, name, NULL, NULL))
 		goto done;
 
+	e.in_use = true;
+	strlcpy (e.name, name, sizeof e.name);
+	e.inode_sector = inode_sector;
+
+	bucket_cnt = dir_bucket_cnt (dir);
+	if (bucket_cnt > 0) {
+		success = dir_add_hashed (dir, &e, bucket_cnt);
+		goto done;
+	}
+
 	/* Set OFS to offset of free slot.
 	 * If there are no free slots, then it will be set to the
 	 * current end-of-file.
@@ -147,18 +331,26 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	 * inode_read_at() will only return a short read at end of file.
 	 * Otherwise, we'd need to verify that we didn't get a short
 	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
+	for (ofs = 0; inode_read_at (dir->inode, &slot, sizeof slot, ofs)
+			== sizeof slot; ofs += sizeof slot)
+		if (!slot.in_use)
 			break;
 
+	/* A large directory with no free slot becomes hashed rather than
+	 * grow. */
+	if (ofs >= inode_length (dir->inode)
+			&& ofs / sizeof e >= DIR_INDEX_THRESHOLD
+			&& dir_rehash (dir, 2 * DIR_INDEX_THRESHOLD / DIR_BUCKET_SLOTS + 1)) {
+		success = dir_add_hashed (dir, &e, dir_bucket_cnt (dir));
+		goto done;
+	}
+
 	/* Write slot. */
-	e.in_use = true;
-	strlcpy (e.name, name, sizeof e.name);
-	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+	if (success)
+		dcache_insert (dir_sector, name, inode_sector);
 	return success;
 }
 
@@ -184,13 +376,16 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode == NULL)
 		goto done;
 
-	/* Erase directory entry. */
+	/* Erase directory entry.  A free entry keeps no name, so that it
+	 * cannot be taken for a hashed directory's header. */
 	e.in_use = false;
+	memset (e.name, 0, sizeof e.name);
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
 	/* Remove inode. */
 	inode_remove (inode);
+	dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NONE);
 	success = true;
 
 done:
@@ -1,5 +1,7 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
+#include "filesys/buffer-cache.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
@@ -22,8 +24,12 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
+	cluster_t last_clst;             /* Where the next free search starts. */
 	struct lock write_lock;
+	struct bitmap *used_clusters;    /* One bit per cluster, true if used. */
+	struct bitmap *dirty_sectors;    /* One bit per FAT sector, true if
+	                                    changed since the last flush. */
+	bool boot_dirty;                 /* Boot sector changed. */
 };
 
 static struct fat_fs *fat_fs;
@@ -41,7 +47,7 @@ fat_init (void) {
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	buffer_cache_read (FAT_BOOT_SECTOR, bounce);
 	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
 	free (bounce);
 
@@ -51,66 +57,87 @@ fat_init (void) {
 	fat_fs_init ();
 }
 
+/* Transfers FAT sectors [FIRST, FIRST + CNT) between the disk and the
+ * in-memory FAT, in as few multi-sector transfers as possible.  The FAT
+ * sectors do not go through the buffer cache: the in-memory FAT is their
+ * only cache. */
+static void
+fat_transfer (size_t first, size_t cnt, bool write) {
+	uint8_t *buffer = (uint8_t *) fat_fs->fat;
+
+	while (cnt > 0) {
+		size_t n = cnt < 256 ? cnt : 256;
+		disk_sector_t sector = fat_fs->bs.fat_start + first;
+		uint8_t *data = buffer + first * DISK_SECTOR_SIZE;
+
+		if (write)
+			disk_write_multi (filesys_disk, sector, n, data);
+		else
+			disk_read_multi (filesys_disk, sector, n, data);
+		first += n;
+		cnt -= n;
+	}
+}
+
+/* Allocates the in-memory FAT, rounded up to whole sectors so that it
+ * can be transferred without bounce buffers. */
+static void
+fat_alloc (void) {
+	fat_fs->fat = calloc (fat_fs->bs.fat_sectors, DISK_SECTOR_SIZE);
+	if (fat_fs->fat == NULL)
+		PANIC ("FAT allocation failed");
+}
+
 void
 fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT load failed");
+	cluster_t clst;
 
-	// Load FAT directly from the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+	/* After fat_create() the FAT is already in memory. */
+	if (fat_fs->fat == NULL) {
+		fat_alloc ();
+		fat_transfer (0, fat_fs->bs.fat_sectors, false);
 	}
+
+	/* Build the free-cluster bitmap.  Cluster 0 does not exist. */
+	fat_fs->used_clusters = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->used_clusters == NULL)
+		PANIC ("FAT load failed");
+	bitmap_mark (fat_fs->used_clusters, 0);
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used_clusters, clst);
 }
 
+/* Writes the FAT sectors changed since the last flush, and the boot
+ * sector if it changed, back to disk. */
 void
 fat_close (void) {
+	size_t first, cnt;
+
 	// Write FAT boot sector
-	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT close failed");
-	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	free (bounce);
+	if (fat_fs->boot_dirty) {
+		uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT close failed");
+		memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
+		buffer_cache_write (FAT_BOOT_SECTOR, bounce);
+		free (bounce);
+		fat_fs->boot_dirty = false;
+	}
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
+	// Write runs of dirty FAT sectors directly to the disk
+	lock_acquire (&fat_fs->write_lock);
+	for (first = 0; first < fat_fs->bs.fat_sectors; first += cnt) {
+		first = bitmap_scan (fat_fs->dirty_sectors, first, 1, true);
+		if (first == BITMAP_ERROR)
+			break;
+		for (cnt = 1; first + cnt < fat_fs->bs.fat_sectors; cnt++)
+			if (!bitmap_test (fat_fs->dirty_sectors, first + cnt))
+				break;
+		fat_transfer (first, cnt, true);
+		bitmap_set_multiple (fat_fs->dirty_sectors, first, cnt, false);
 	}
+	lock_release (&fat_fs->write_lock);
 }
 
 void
@@ -119,10 +146,9 @@ fat_create (void) {
 	fat_boot_create ();
 	fat_fs_init ();
 
-	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT creation failed");
+	// Create FAT table.  Every sector of it must be written out.
+	fat_alloc ();
+	bitmap_set_all (fat_fs->dirty_sectors, true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -131,7 +157,7 @@ fat_create (void) {
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	buffer_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), buf);
 	free (buf);
 }
 
@@ -148,46 +174,108 @@ fat_boot_create (void) {
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
 	};
+	fat_fs->boot_dirty = true;
 }
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	/* Data clusters follow the FAT.  Cluster 0 means "free" in the FAT,
+	 * so clusters are numbered from 1. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+	                     / SECTORS_PER_CLUSTER + 1;
+	if (fat_fs->fat_length > fat_fs->bs.fat_sectors
+	                         * (DISK_SECTOR_SIZE / sizeof (cluster_t)))
+		fat_fs->fat_length =
+		    fat_fs->bs.fat_sectors * (DISK_SECTOR_SIZE / sizeof (cluster_t));
+	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+	lock_init (&fat_fs->write_lock);
+
+	/* Formatting calls this a second time, for the new boot sector. */
+	bitmap_destroy (fat_fs->dirty_sectors);
+	fat_fs->dirty_sectors = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->dirty_sectors == NULL)
+		PANIC ("FAT init failed");
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Allocates a free cluster, searching from where the last search left
+ * off, and marks it as the end of a chain.  Returns 0 if the disk is
+ * full.  WRITE_LOCK must be held. */
+static cluster_t
+fat_alloc_cluster (void) {
+	size_t clst;
+
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+
+	clst = bitmap_scan_and_flip (fat_fs->used_clusters, fat_fs->last_clst, 1,
+	                             false);
+	if (clst == BITMAP_ERROR)
+		clst = bitmap_scan_and_flip (fat_fs->used_clusters, 1, 1, false);
+	if (clst == BITMAP_ERROR)
+		return 0;
+	fat_fs->last_clst = clst + 1;
+	fat_put (clst, EOChain);
+	return clst;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new_clst;
+
+	lock_acquire (&fat_fs->write_lock);
+	new_clst = fat_alloc_cluster ();
+	if (new_clst != 0 && clst != 0)
+		fat_put (clst, new_clst);
+	lock_release (&fat_fs->write_lock);
+	return new_clst;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+
+		fat_put (clst, 0);
+		bitmap_reset (fat_fs->used_clusters, clst);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	fat_fs->fat[clst] = val;
+	bitmap_mark (fat_fs->dirty_sectors,
+	             clst / (DISK_SECTOR_SIZE / sizeof (cluster_t)));
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
 }
@@ -1,15 +1,32 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Readahead window bounds, in bytes.  The window starts at RA_MIN_WINDOW
+ * on the first sequential read, doubles on each further one up to
+ * RA_MAX_WINDOW, and closes on a random read. */
+#define RA_MIN_WINDOW (4 * DISK_SECTOR_SIZE)
+#define RA_MAX_WINDOW (16 * DISK_SECTOR_SIZE)
+
+/* Bytes moved at a time by file_copy_range(). */
+#define COPY_CHUNK (16 * DISK_SECTOR_SIZE)
+
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+
+	/* Sequential readahead. */
+	off_t ra_next;              /* Offset a sequential read would start at. */
+	off_t ra_window;            /* Bytes to keep read ahead, 0 if random. */
+	off_t ra_end;               /* End of what has been read ahead. */
 };
 
+static void file_readahead (struct file *, off_t ofs, off_t bytes_read);
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
@@ -20,6 +37,9 @@ file_open (struct inode *inode) {
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->ra_next = 0;
+		file->ra_window = 0;
+		file->ra_end = 0;
 		return file;
 	} else {
 		inode_close (inode);
@@ -72,6 +92,7 @@ file_get_inode (struct file *file) {
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
 	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	file_readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +104,43 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+	file_readahead (file, file_ofs, bytes_read);
+	return bytes_read;
+}
+
+/* Updates FILE's readahead state after BYTES_READ bytes were read at
+ * offset OFS.  A read that continues the previous one widens the window;
+ * any other read closes it.  While the window is open, the data after
+ * OFS + BYTES_READ is kept read ahead into the buffer cache, so that it
+ * is there by the time the reader gets to it. */
+static void
+file_readahead (struct file *file, off_t ofs, off_t bytes_read) {
+	off_t end, start;
+
+	if (bytes_read == 0)
+		return;
+
+	if (ofs == file->ra_next) {
+		if (file->ra_window == 0)
+			file->ra_window = RA_MIN_WINDOW;
+		else if (file->ra_window < RA_MAX_WINDOW)
+			file->ra_window *= 2;
+	} else {
+		file->ra_window = 0;
+		file->ra_end = 0;
+	}
+	file->ra_next = ofs + bytes_read;
+	if (file->ra_window == 0)
+		return;
+
+	/* Read ahead whatever part of the window is not yet under way. */
+	end = file->ra_next + file->ra_window;
+	start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+	if (start < end) {
+		inode_readahead (file->inode, start, end - start);
+		file->ra_end = end;
+	}
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -113,6 +170,67 @@ file_write_at (struct file *file, const void *buffer, off_t size,
 	return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies SIZE bytes of file IN starting at offset IN_OFS to file OUT
+ * starting at offset OUT_OFS, growing OUT if needed.  The data moves
+ * through a kernel buffer a chunk at a time; source sectors that are
+ * not cached are read straight from disk, so a large copy does not
+ * empty the buffer cache.  The files' positions are unaffected.
+ * Returns the number of bytes copied, which may be less than SIZE if
+ * the end of IN is reached, OUT cannot be written, or memory runs out. */
+off_t
+file_copy_range (struct file *in, off_t in_ofs, struct file *out,
+		off_t out_ofs, off_t size) {
+	off_t bytes_copied = 0;
+	uint8_t *buffer = malloc (COPY_CHUNK);
+
+	if (buffer == NULL)
+		return 0;
+	while (size > 0) {
+		off_t chunk_size = size < COPY_CHUNK ? size : COPY_CHUNK;
+		off_t bytes_read, bytes_written;
+
+		bytes_read = inode_read_stream (in->inode, buffer, chunk_size,
+				in_ofs + bytes_copied);
+		if (bytes_read == 0)
+			break;
+		bytes_written = inode_write_at (out->inode, buffer, bytes_read,
+				out_ofs + bytes_copied);
+		bytes_copied += bytes_written;
+		size -= bytes_written;
+		if (bytes_written < chunk_size)
+			break;
+	}
+	free (buffer);
+	return bytes_copied;
+}
+
+/* Allocates disk space for the LEN bytes of FILE starting at offset OFS,
+ * growing FILE if they go past its end, so that writing them later
+ * does not fail for lack of space and keeps them together on disk.
+ * Returns true if successful, false if the disk is full or writes
+ * to FILE are denied. */
+bool
+file_preallocate (struct file *file, off_t ofs, off_t len) {
+	/* Sectors released by the running journal transaction only become
+	 * free once it commits. */
+	return (inode_reserve (file->inode, ofs, len)
+			|| (free_map_reclaim () && inode_reserve (file->inode, ofs, len)));
+}
+
+/* Makes the data written to FILE durable, along with all of its
+ * metadata.  Returns false if some of it was lost. */
+bool
+file_sync (struct file *file) {
+	return inode_sync (file->inode);
+}
+
+/* Makes the data written to FILE durable, along with only the metadata
+ * needed to read it back.  Returns false if some of it was lost. */
+bool
+file_datasync (struct file *file) {
+	return inode_datasync (file->inode);
+}
+
 /* Prevents write operations on FILE's underlying inode
  * until file_allow_write() is called or FILE is closed. */
 void
@@ -2,9 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer-cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
 
@@ -21,7 +24,10 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
+	journal_init ();
 	inode_init ();
+	dcache_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -37,6 +43,7 @@ filesys_init (bool format) {
 	if (format)
 		do_format ();
 
+	journal_recover ();
 	free_map_open ();
 #endif
 }
@@ -45,33 +52,66 @@ filesys_init (bool format) {
  * to disk. */
 void
 filesys_done (void) {
+	inode_flush_delayed_all ();
+
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
+	journal_done ();
 	free_map_close ();
 #endif
+	buffer_cache_flush ();
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
- * Returns true if successful, false otherwise.
- * Fails if a file named NAME already exists,
- * or if internal memory allocation fails. */
-bool
-filesys_create (const char *name, off_t initial_size) {
+/* Writes all buffered file system changes to disk, in dependency order:
+ * delayed data gets its sectors, the metadata changes made so far
+ * commit after the data they point to, and the remaining dirty sectors
+ * follow. */
+void
+filesys_sync (void) {
+	inode_flush_delayed_all ();
+	journal_commit ();
+	buffer_cache_flush ();
+}
+
+/* Creates a file named NAME with the given INITIAL_SIZE, for
+ * filesys_create(). */
+static bool
+create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
+	struct dir *dir;
+	bool success;
+
+	/* Allocating the inode, writing it and adding it to the directory
+	 * reach the disk together or not at all. */
+	journal_begin ();
+	dir = dir_open_root ();
+	success = (dir != NULL
+			&& free_map_allocate_near (inode_get_inumber (dir_get_inode (dir)),
+				1, &inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
 	dir_close (dir);
+	journal_end ();
 
 	return success;
 }
 
+/* Creates a file named NAME with the given INITIAL_SIZE.
+ * Returns true if successful, false otherwise.
+ * Fails if a file named NAME already exists,
+ * or if internal memory allocation fails. */
+bool
+filesys_create (const char *name, off_t initial_size) {
+	/* Sectors released by the running journal transaction only become
+	 * free once it commits. */
+	return (create (name, initial_size)
+			|| (free_map_reclaim () && create (name, initial_size)));
+}
+
 /* Opens the file with the given NAME.
  * Returns the new file if successful or a null pointer
  * otherwise.
@@ -95,9 +135,14 @@ filesys_open (const char *name) {
  * or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) {
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	struct dir *dir;
+	bool success;
+
+	journal_begin ();
+	dir = dir_open_root ();
+	success = dir != NULL && dir_remove (dir, name);
 	dir_close (dir);
+	journal_end ();
 
 	return success;
 }
@@ -116,6 +161,7 @@ do_format (void) {
 	if (!dir_create (ROOT_DIR_SECTOR, 16))
 		PANIC ("root directory creation failed");
 	free_map_close ();
+	journal_create ();
 #endif
 
 	printf ("done.\n");
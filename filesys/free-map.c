@@ -1,13 +1,64 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
 
+/* One bit per sector of the free map file, true if the part of the free
+ * map it holds changed since it was last written.  Only those sectors
+ * are written back, at the next free_map_flush(). */
+static struct bitmap *dirty_sectors;
+
+/* Number of free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+
+/* The disk is divided into allocation groups of GROUP_SECTORS sectors.
+ * Allocations go to the group of a goal sector, such as the inode of
+ * the directory or file they belong to, so that related data stays
+ * close together; a group only spills over into the next one once it
+ * is full. */
+#define GROUP_SECTORS 1024
+
+/* An allocation group. */
+struct alloc_group {
+	size_t free_cnt;                 /* Number of free sectors. */
+	disk_sector_t hint;              /* No free sector lies below this. */
+};
+
+static struct alloc_group *groups;
+static size_t group_cnt;
+
+/* Free sectors in all groups, and how many of them are promised to data
+ * that is buffered in memory until it is written back.  Allocations
+ * leave the promised sectors alone, so that writing back buffered data
+ * cannot run out of space. */
+static size_t total_free;
+static size_t reserved_cnt;
+
+/* Sectors released by operations of the running journal transaction.
+ * They stay in use until it commits, so that they cannot be allocated
+ * again and overwritten while the metadata on disk still points to
+ * them. */
+static struct bitmap *released;
+static size_t released_cnt;
+
+/* Protects all of the above.  Since free_map_flush() writes the free
+ * map file with this lock held, the free map file itself must never
+ * need to allocate sectors once it exists. */
+static struct lock free_map_lock;
+
+static void count_free (void);
+
 /* Initializes the free map. */
 void
 free_map_init (void) {
@@ -16,6 +67,98 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+	dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+				DISK_SECTOR_SIZE));
+	released = bitmap_create (bitmap_size (free_map));
+	released_cnt = 0;
+	group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+	groups = calloc (group_cnt, sizeof *groups);
+	if (dirty_sectors == NULL || released == NULL || groups == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
+	lock_init (&free_map_lock);
+	count_free ();
+}
+
+/* Returns the first sector of group G. */
+static disk_sector_t
+group_start (size_t g) {
+	return g * GROUP_SECTORS;
+}
+
+/* Returns the sector just past the end of group G. */
+static disk_sector_t
+group_end (size_t g) {
+	size_t end = (g + 1) * GROUP_SECTORS;
+	return end < bitmap_size (free_map) ? end : bitmap_size (free_map);
+}
+
+/* Recomputes every group's free count from the free map, and resets
+ * the search hints. */
+static void
+count_free (void) {
+	size_t g;
+
+	total_free = 0;
+	for (g = 0; g < group_cnt; g++) {
+		groups[g].free_cnt = bitmap_count (free_map, group_start (g),
+				group_end (g) - group_start (g), false);
+		groups[g].hint = group_start (g);
+		total_free += groups[g].free_cnt;
+	}
+}
+
+/* Marks the CNT sectors starting at SECTOR as used, if USED is true, or
+ * free, updating the group counts and hints.  FREE_MAP_LOCK must be
+ * held. */
+static void
+set_sectors (disk_sector_t sector, size_t cnt, bool used) {
+	disk_sector_t end = sector + cnt;
+
+	bitmap_set_multiple (free_map, sector, cnt, used);
+	if (used)
+		total_free -= cnt;
+	else
+		total_free += cnt;
+	while (sector < end) {
+		size_t g = sector / GROUP_SECTORS;
+		disk_sector_t stop = end < group_end (g) ? end : group_end (g);
+
+		if (used) {
+			groups[g].free_cnt -= stop - sector;
+			if (groups[g].hint == sector)
+				groups[g].hint = stop;
+		} else {
+			groups[g].free_cnt += stop - sector;
+			if (sector < groups[g].hint)
+				groups[g].hint = sector;
+		}
+		sector = stop;
+	}
+}
+
+/* Returns the first run of CNT free sectors that starts in group G, or
+ * BITMAP_ERROR.  FREE_MAP_LOCK must be held. */
+static disk_sector_t
+scan_group (size_t g, size_t cnt) {
+	disk_sector_t sector;
+
+	if (groups[g].free_cnt < cnt && cnt <= GROUP_SECTORS)
+		return BITMAP_ERROR;
+	sector = bitmap_scan (free_map, groups[g].hint, cnt, false);
+	if (sector == BITMAP_ERROR || sector >= group_end (g))
+		return BITMAP_ERROR;
+	return sector;
+}
+
+/* Marks the free map file sectors holding the bits for the CNT sectors
+ * starting at SECTOR as dirty.  FREE_MAP_LOCK must be held. */
+static void
+mark_dirty (disk_sector_t sector, size_t cnt) {
+	size_t first = sector / BITS_PER_SECTOR;
+	size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+	bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,40 +167,194 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
-	}
-	if (sector != BITMAP_ERROR)
+	return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* Allocates CNT consecutive sectors from the free map, preferably in
+ * the allocation group of sector GOAL or else in the groups after it,
+ * and stores the first into *SECTORP.
+ * Returns true if successful, false if all sectors were
+ * available. */
+bool
+free_map_allocate_near (disk_sector_t goal, size_t cnt,
+		disk_sector_t *sectorp) {
+	disk_sector_t sector = BITMAP_ERROR;
+	size_t first, i;
+
+	lock_acquire (&free_map_lock);
+	first = goal < bitmap_size (free_map) ? goal / GROUP_SECTORS : 0;
+	for (i = 0; i < group_cnt && sector == BITMAP_ERROR
+			&& total_free - reserved_cnt >= cnt; i++)
+		sector = scan_group ((first + i) % group_cnt, cnt);
+	if (sector != BITMAP_ERROR) {
+		set_sectors (sector, cnt, true);
+		mark_dirty (sector, cnt);
 		*sectorp = sector;
+	}
+	lock_release (&free_map_lock);
 	return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates the CNT sectors starting at SECTOR, if they are all free.
+ * Returns true if successful, false if any of them is in use. */
+bool
+free_map_allocate_at (disk_sector_t sector, size_t cnt) {
+	bool success = false;
+
+	lock_acquire (&free_map_lock);
+	if (sector + cnt <= bitmap_size (free_map)
+			&& total_free - reserved_cnt >= cnt
+			&& bitmap_none (free_map, sector, cnt)) {
+		set_sectors (sector, cnt, true);
+		mark_dirty (sector, cnt);
+		success = true;
+	}
+	lock_release (&free_map_lock);
+	return success;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use once the
+ * running journal transaction commits. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
-	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	ASSERT (bitmap_none (released, sector, cnt));
+	bitmap_set_multiple (released, sector, cnt, true);
+	released_cnt += cnt;
+	lock_release (&free_map_lock);
+}
+
+/* Frees the sectors released since the last call.  Called by the
+ * journal once the transaction that released them has committed. */
+void
+free_map_commit (void) {
+	size_t start, cnt;
+
+	lock_acquire (&free_map_lock);
+	for (start = 0; released_cnt > 0; start += cnt) {
+		start = bitmap_scan (released, start, 1, true);
+		ASSERT (start != BITMAP_ERROR);
+		for (cnt = 1; start + cnt < bitmap_size (released); cnt++)
+			if (!bitmap_test (released, start + cnt))
+				break;
+		bitmap_set_multiple (released, start, cnt, false);
+		released_cnt -= cnt;
+		set_sectors (start, cnt, false);
+		mark_dirty (start, cnt);
+	}
+	lock_release (&free_map_lock);
+}
+
+/* Commits the running journal transaction if it has released sectors,
+ * so that an operation that found the disk full can try again.  Returns
+ * true if it did.  Does nothing if called within an operation, which the
+ * commit would have to wait for. */
+bool
+free_map_reclaim (void) {
+	bool pending;
+
+	if (thread_current ()->journal_depth > 0)
+		return false;
+
+	lock_acquire (&free_map_lock);
+	pending = released_cnt > 0;
+	lock_release (&free_map_lock);
+	if (pending)
+		journal_commit ();
+	return pending;
+}
+
+/* Promises CNT free sectors to data that is not yet allocated on disk.
+ * Returns true if successful, false if fewer than CNT sectors are free
+ * beyond those already promised. */
+bool
+free_map_reserve (size_t cnt) {
+	bool success = false;
+
+	lock_acquire (&free_map_lock);
+	if (total_free - reserved_cnt >= cnt) {
+		reserved_cnt += cnt;
+		success = true;
+	}
+	lock_release (&free_map_lock);
+	return success;
+}
+
+/* Withdraws a promise of CNT sectors made by free_map_reserve(), so that
+ * they can be allocated. */
+void
+free_map_unreserve (size_t cnt) {
+	lock_acquire (&free_map_lock);
+	ASSERT (reserved_cnt >= cnt);
+	reserved_cnt -= cnt;
+	lock_release (&free_map_lock);
+}
+
+/* Writes up to MAX of the sectors of the free map file whose part of
+ * the free map changed since they were last written, in runs of
+ * consecutive sectors. */
+void
+free_map_flush (size_t max) {
+	size_t first, cnt;
+
+	/* Nothing to do if the file system does not use the free map. */
+	if (free_map == NULL)
+		return;
+
+	lock_acquire (&free_map_lock);
+	if (free_map_file != NULL) {
+		for (first = 0; max > 0; first += cnt) {
+			first = bitmap_scan (dirty_sectors, first, 1, true);
+			if (first == BITMAP_ERROR)
+				break;
+			for (cnt = 1; cnt < max && first + cnt < bitmap_size (dirty_sectors);
+					cnt++)
+				if (!bitmap_test (dirty_sectors, first + cnt))
+					break;
+			if (!bitmap_write_range (free_map, free_map_file,
+						first * DISK_SECTOR_SIZE, cnt * DISK_SECTOR_SIZE))
+				PANIC ("can't write free map");
+			bitmap_set_multiple (dirty_sectors, first, cnt, false);
+			max -= cnt;
+		}
+	}
+	lock_release (&free_map_lock);
 }
 
+/* Returns the number of free map file sectors that free_map_flush() has
+ * yet to write. */
+size_t
+free_map_dirty_cnt (void) {
+	size_t cnt = 0;
+
+	if (free_map == NULL)
+		return 0;
+
+	lock_acquire (&free_map_lock);
+	if (free_map_file != NULL)
+		cnt = bitmap_count (dirty_sectors, 0, bitmap_size (dirty_sectors), true);
+	lock_release (&free_map_lock);
+	return cnt;
+}
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_metadata (file_get_inode (free_map_file));
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	count_free ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_flush (SIZE_MAX);
 	file_close (free_map_file);
+	free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -68,10 +365,15 @@ free_map_create (void) {
 	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
 		PANIC ("free map creation failed");
 
-	/* Write bitmap to file. */
+	/* Write bitmap to file.  Its sectors are allocated up front, since
+	 * writing back delayed data would need the free map, and so that
+	 * the bitmap written includes them. */
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	if (!file_preallocate (free_map_file, 0, bitmap_file_size (free_map)))
+		PANIC ("free map creation failed");
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (dirty_sectors, false);
 }
@@ -1,22 +1,59 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer-cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of LENGTH sectors of a file stored at consecutive disk sectors
+ * starting at START.  A START of 0 marks a hole: sectors that have never
+ * been written, which read as zeros and take no disk space.  (Sector 0
+ * never holds file data.) */
+struct extent {
+	disk_sector_t start;                /* First disk sector, 0 if hole. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+/* Number of extents in the inode itself and in its indirect block. */
+#define DIRECT_EXTENTS 60
+#define INDIRECT_EXTENTS (DISK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (DIRECT_EXTENTS + INDIRECT_EXTENTS)
+
+/* Files up to INLINE_MAX bytes long keep their data in the inode, in
+ * place of the direct extents, and take no other disk space.  A file
+ * that grows past it moves its data out to extents for good. */
+#define INLINE_MAX (DIRECT_EXTENTS * sizeof (struct extent))
+
+/* Inode flags. */
+#define INODE_INLINE 0x1                /* Data stored in the inode. */
+
+/* A sector's worth of zeros. */
+static const uint8_t zeros[DISK_SECTOR_SIZE];
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t sector_cnt;                /* Sectors covered by extents. */
+	uint32_t extent_cnt;                /* Number of extents. */
+	disk_sector_t indirect;             /* Extents past the direct ones. */
+	uint32_t flags;                     /* INODE_* flags. */
+	uint32_t unused[2];                 /* Not used. */
+	union {
+		struct extent extents[DIRECT_EXTENTS];  /* First extents, in order. */
+		uint8_t data[INLINE_MAX];       /* Data if INODE_INLINE. */
+	};
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,47 +63,608 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* An extent of an in-memory inode, with the file sector it starts at
+ * so that lookups can binary-search. */
+struct run {
+	uint32_t first;                     /* First file sector. */
+	struct extent ext;                  /* Where it is stored. */
+};
+
+/* Data written to a sector of a file that lies in a hole.  Such data is
+ * kept in memory and only given disk sectors when it is written back, so
+ * that a file that grows by small writes gets one run of sectors for
+ * many of them rather than one allocation per write. */
+struct delayed_sector {
+	struct list_elem elem;              /* Element in inode's DELAYED. */
+	uint32_t sector_idx;                /* File sector. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Contents. */
+};
+
+/* Maximum number of delayed sectors per inode.  Writing more first
+ * writes back the ones buffered so far. */
+#define DELAYED_MAX 64
+
+/* In-memory inode.  Holds the decoded contents of the on-disk inode
+ * rather than a copy of its sector. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
+	struct list_elem lru_elem;          /* Element in unused_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-	struct inode_disk data;             /* Inode content. */
+	bool metadata;                      /* Data written through journal? */
+
+	/* Protected by LOCK. */
+	struct lock lock;                   /* Protects the members below. */
+	off_t length;                       /* File size in bytes. */
+	uint32_t sector_cnt;                /* Sectors covered by extents. */
+	disk_sector_t indirect;             /* Extents past the direct ones. */
+	size_t extent_cnt;                  /* Number of extents. */
+	size_t extent_cap;                  /* Number of RUNS allocated. */
+	struct run *runs;                   /* Extent map. */
+	uint8_t *inline_data;               /* INLINE_MAX bytes if inline. */
+	struct list delayed;                /* Delayed sectors, by SECTOR_IDX. */
+	size_t delayed_cnt;                 /* Number of delayed sectors. */
+	uint32_t meta_txn;                  /* Journal transaction of last change. */
+	uint32_t data_txn;                  /* Same, of last change reads need. */
+	bool data_dirty;                    /* Length, sectors or inline data
+	                                       changed since inode_flush()? */
+
+	/* Element in delayed_inodes while DELAYED is not empty.  Protected
+	 * by open_inodes_lock. */
+	struct list_elem delayed_elem;
 };
 
+/* Returns extent IDX of INODE. */
+static struct extent
+get_extent (const struct inode *inode, size_t idx) {
+	ASSERT (idx < inode->extent_cnt);
+	return inode->runs[idx].ext;
+}
+
+/* Sets extent IDX of INODE to EXT. */
+static void
+put_extent (struct inode *inode, size_t idx, struct extent ext) {
+	ASSERT (idx < inode->extent_cnt);
+	inode->runs[idx].ext = ext;
+}
+
+/* Recomputes the first file sector of INODE's runs from IDX on, after a
+ * change to the extent map. */
+static void
+renumber_runs (struct inode *inode, size_t idx) {
+	uint32_t first = 0;
+
+	if (idx > 0)
+		first = inode->runs[idx - 1].first + inode->runs[idx - 1].ext.length;
+	for (; idx < inode->extent_cnt; idx++) {
+		inode->runs[idx].first = first;
+		first += inode->runs[idx].ext.length;
+	}
+}
+
+/* Makes sure INODE has room for CNT extents.  Returns false if out of
+ * memory. */
+static bool
+reserve_runs (struct inode *inode, size_t cnt) {
+	struct run *runs;
+	size_t cap;
+
+	if (cnt <= inode->extent_cap)
+		return true;
+	cap = inode->extent_cap > 0 ? inode->extent_cap : 4;
+	while (cap < cnt)
+		cap *= 2;
+	runs = realloc (inode->runs, cap * sizeof *runs);
+	if (runs == NULL)
+		return false;
+	inode->runs = runs;
+	inode->extent_cap = cap;
+	return true;
+}
+
+/* Reads INODE's on-disk inode from its sector and decodes it.  Returns
+ * false if out of memory. */
+static bool
+inode_load (struct inode *inode) {
+	struct inode_disk *disk_inode;
+	size_t idx;
+	bool success = false;
+
+	inode->extent_cnt = 0;
+	inode->extent_cap = 0;
+	inode->runs = NULL;
+	inode->inline_data = NULL;
+	disk_inode = malloc (sizeof *disk_inode);
+	if (disk_inode == NULL)
+		return false;
+	buffer_cache_read (inode->sector, disk_inode);
+
+	inode->length = disk_inode->length;
+	inode->sector_cnt = disk_inode->sector_cnt;
+	inode->indirect = disk_inode->indirect;
+	if (disk_inode->flags & INODE_INLINE) {
+		inode->inline_data = malloc (INLINE_MAX);
+		if (inode->inline_data == NULL)
+			goto done;
+		memcpy (inode->inline_data, disk_inode->data, INLINE_MAX);
+		success = true;
+		goto done;
+	}
+	if (!reserve_runs (inode, disk_inode->extent_cnt))
+		goto done;
+	inode->extent_cnt = disk_inode->extent_cnt;
+	for (idx = 0; idx < inode->extent_cnt; idx++)
+		if (idx < DIRECT_EXTENTS)
+			inode->runs[idx].ext = disk_inode->extents[idx];
+		else
+			buffer_cache_read_at (inode->indirect, &inode->runs[idx].ext,
+					(idx - DIRECT_EXTENTS) * sizeof (struct extent),
+					sizeof (struct extent));
+	renumber_runs (inode, 0);
+	success = true;
+
+done:
+	free (disk_inode);
+	return success;
+}
+
+/* Encodes INODE and writes it back through the journal, along with its
+ * indirect block if it has one.  INODE's lock must be held. */
+static void
+inode_flush (struct inode *inode) {
+	struct inode_disk *disk_inode;
+	struct extent *indirect;
+	size_t idx;
+
+	/* A second sector's worth of space holds the indirect extents. */
+	disk_inode = calloc (2, DISK_SECTOR_SIZE);
+	if (disk_inode == NULL)
+		PANIC ("out of memory writing inode %"PRDSNu, inode->sector);
+	indirect = (struct extent *) (disk_inode + 1);
+
+	disk_inode->length = inode->length;
+	disk_inode->magic = INODE_MAGIC;
+	disk_inode->sector_cnt = inode->sector_cnt;
+	disk_inode->extent_cnt = inode->extent_cnt;
+	disk_inode->indirect = inode->indirect;
+	if (inode->inline_data != NULL) {
+		disk_inode->flags = INODE_INLINE;
+		memcpy (disk_inode->data, inode->inline_data, INLINE_MAX);
+	}
+	for (idx = 0; idx < inode->extent_cnt; idx++)
+		if (idx < DIRECT_EXTENTS)
+			disk_inode->extents[idx] = inode->runs[idx].ext;
+		else
+			indirect[idx - DIRECT_EXTENTS] = inode->runs[idx].ext;
+	journal_write (inode->sector, disk_inode, 0, DISK_SECTOR_SIZE);
+	if (inode->extent_cnt > DIRECT_EXTENTS)
+		journal_write (inode->indirect, indirect, 0, DISK_SECTOR_SIZE);
+	inode->meta_txn = journal_txn ();
+	if (inode->data_dirty) {
+		inode->data_txn = inode->meta_txn;
+		inode->data_dirty = false;
+	}
+	free (disk_inode);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of disk sector
+ * SECTOR, which holds data of INODE, through the journal if INODE holds
+ * metadata. */
+static void
+write_data (struct inode *inode, disk_sector_t sector, const void *buffer,
+		int ofs, int size) {
+	if (inode->metadata)
+		journal_write (sector, buffer, ofs, size);
+	else
+		buffer_cache_write_at (sector, buffer, ofs, size);
+}
+
+/* Finds the extent of INODE that holds file sector SECTOR_IDX.  Returns
+ * its index and stores the file sector it begins at into *FIRSTP.
+ * SECTOR_IDX must be covered by the extent map.  INODE's lock must be
+ * held. */
+static size_t
+find_extent (struct inode *inode, size_t sector_idx, size_t *firstp) {
+	size_t lo = 0, hi = inode->extent_cnt;
+
+	ASSERT (sector_idx < inode->sector_cnt);
+
+	/* Find the last run that starts at or before SECTOR_IDX. */
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (inode->runs[mid].first <= sector_idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	*firstp = inode->runs[lo].first;
+	return lo;
+}
+
+/* Returns the disk sector that holds file sector SECTOR_IDX of INODE, or
+ * 0 if it lies in a hole.  SECTOR_IDX must be covered by the extent map.
+ * INODE's lock must be held. */
+static disk_sector_t
+idx_to_sector (struct inode *inode, size_t sector_idx) {
+	struct extent ext;
+	size_t first;
+
+	ext = get_extent (inode, find_extent (inode, sector_idx, &first));
+	return ext.start != 0 ? ext.start + (sector_idx - first) : 0;
+}
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
- * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * INODE, or 0 if POS lies in a hole.
+ * POS must be covered by the extent map. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	disk_sector_t sector;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
-		return -1;
+	lock_acquire (&inode->lock);
+	sector = idx_to_sector (inode, pos / DISK_SECTOR_SIZE);
+	lock_release (&inode->lock);
+	return sector;
+}
+
+/* Makes room for CNT more extents at index IDX of INODE, moving the
+ * extents from IDX on up.  The caller must fill in the new extents and
+ * then call renumber_runs().  Returns false if the extent map is full
+ * or memory runs out. */
+static bool
+insert_extents (struct inode *inode, size_t idx, size_t cnt) {
+	if (inode->extent_cnt + cnt > MAX_EXTENTS
+			|| !reserve_runs (inode, inode->extent_cnt + cnt))
+		return false;
+	if (inode->extent_cnt + cnt > DIRECT_EXTENTS && inode->indirect == 0) {
+		if (!free_map_allocate_near (inode->sector, 1, &inode->indirect))
+			return false;
+	}
+
+	memmove (inode->runs + idx + cnt, inode->runs + idx,
+			(inode->extent_cnt - idx) * sizeof *inode->runs);
+	inode->extent_cnt += cnt;
+	return true;
+}
+
+/* Extends INODE's extent map with a hole so that it covers SECTORS
+ * sectors.  Returns false if the extent map is full. */
+static bool
+extend_extents (struct inode *inode, size_t sectors) {
+	size_t cnt = inode->extent_cnt;
+	struct extent hole = { 0, 0 };
+
+	if (sectors <= inode->sector_cnt)
+		return true;
+
+	if (cnt > 0 && get_extent (inode, cnt - 1).start == 0) {
+		hole = get_extent (inode, cnt - 1);
+		cnt--;
+	} else if (!insert_extents (inode, cnt, 1))
+		return false;
+
+	hole.length += sectors - inode->sector_cnt;
+	put_extent (inode, cnt, hole);
+	renumber_runs (inode, cnt);
+	inode->sector_cnt = sectors;
+	return true;
+}
+
+/* Allocates CNT sectors at GOAL if they are free, or else near sector
+ * NEAR.  Falls back to shorter runs if no run of CNT sectors is free.
+ * On success stores the first sector into *SECTORP and returns the
+ * number of sectors allocated; returns 0 if the disk is full. */
+static size_t
+allocate_run (disk_sector_t goal, disk_sector_t near, size_t cnt,
+		disk_sector_t *sectorp) {
+	for (; cnt > 0; cnt /= 2) {
+		if (goal != 0 && free_map_allocate_at (goal, cnt)) {
+			*sectorp = goal;
+			return cnt;
+		}
+		if (free_map_allocate_near (near, cnt, sectorp))
+			return cnt;
+	}
+	return 0;
+}
+
+/* Allocates disk sectors for up to CNT sectors of INODE starting at file
+ * sector SECTOR_IDX, which must lie in a hole.  The new sectors are
+ * placed right after the data before the hole when possible, so that a
+ * file written in order stays contiguous on disk, and otherwise in the
+ * allocation group of the inode itself.  On success, stores
+ * the first new disk sector into *SECTORP and returns the number of
+ * sectors allocated, which may be less than CNT.  Returns 0 if the disk
+ * or the extent map is full.  INODE's lock must be held. */
+static size_t
+fill_hole (struct inode *inode, size_t sector_idx, size_t cnt,
+		disk_sector_t *sectorp) {
+	size_t idx, first, before, after;
+	struct extent hole, prev = { 0, 0 };
+	disk_sector_t goal = 0;
+
+	ASSERT (lock_held_by_current_thread (&inode->lock));
+
+	idx = find_extent (inode, sector_idx, &first);
+	hole = get_extent (inode, idx);
+	ASSERT (hole.start == 0);
+	if (cnt > first + hole.length - sector_idx)
+		cnt = first + hole.length - sector_idx;
+	before = sector_idx - first;
+
+	if (idx > 0)
+		prev = get_extent (inode, idx - 1);
+	if (before == 0 && prev.start != 0)
+		goal = prev.start + prev.length;
+
+	/* Make sure the extent map has room before allocating. */
+	if (inode->extent_cnt + 2 > MAX_EXTENTS)
+		return 0;
+	cnt = allocate_run (goal, goal != 0 ? goal : inode->sector, cnt, sectorp);
+	if (cnt == 0)
+		return 0;
+	after = hole.length - before - cnt;
+
+	/* Replace the hole by up to three pieces: the hole before the new
+	 * sectors, the new sectors, and the hole after them.  New sectors
+	 * that continue the previous extent just lengthen it. */
+	if (before == 0 && prev.start != 0 && *sectorp == goal) {
+		prev.length += cnt;
+		put_extent (inode, idx - 1, prev);
+		if (after == 0) {
+			memmove (inode->runs + idx, inode->runs + idx + 1,
+					(inode->extent_cnt - idx - 1) * sizeof *inode->runs);
+			inode->extent_cnt--;
+		} else
+			put_extent (inode, idx, (struct extent) { 0, after });
+		renumber_runs (inode, idx - 1);
+	} else {
+		size_t pieces = (before > 0) + 1 + (after > 0);
+		if (!insert_extents (inode, idx + 1, pieces - 1)) {
+			free_map_release (*sectorp, cnt);
+			return 0;
+		}
+		if (before > 0)
+			put_extent (inode, idx + 0, (struct extent) { 0, before });
+		put_extent (inode, idx + (before > 0), (struct extent) { *sectorp, cnt });
+		if (after > 0)
+			put_extent (inode, idx + pieces - 1, (struct extent) { 0, after });
+		renumber_runs (inode, idx);
+	}
+	inode->data_dirty = true;
+	return cnt;
+}
+
+/* Releases all of INODE's disk sectors, including its indirect block. */
+static void
+release_extents (struct inode *inode) {
+	size_t idx;
+
+	for (idx = 0; idx < inode->extent_cnt; idx++) {
+		struct extent ext = get_extent (inode, idx);
+		if (ext.start != 0)
+			free_map_release (ext.start, ext.length);
+	}
+	if (inode->indirect != 0)
+		free_map_release (inode->indirect, 1);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Inodes with delayed sectors.  Protected by open_inodes_lock, which
+ * may be acquired with an inode's lock held but not the other way
+ * around. */
+static struct list delayed_inodes;
+
+/* Open inodes, hashed by sector, so that opening a single inode twice
+ * returns the same `struct inode'.  Also holds up to UNUSED_INODE_MAX
+ * recently closed inodes, with an OPEN_CNT of 0, so that a file that is
+ * opened again soon after being closed need not be read and decoded
+ * again. */
+static struct hash open_inodes;
+
+/* Recently closed inodes still in OPEN_INODES, least recently closed
+ * first. */
+#define UNUSED_INODE_MAX 32
+static struct list unused_inodes;
+static size_t unused_cnt;
+
+/* Protects OPEN_INODES, UNUSED_INODES and the OPEN_CNT of every inode in
+ * them. */
+static struct lock open_inodes_lock;
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+		PANIC ("open inode table creation failed");
+	list_init (&unused_inodes);
+	unused_cnt = 0;
+	list_init (&delayed_inodes);
+	lock_init (&open_inodes_lock);
+}
+
+/* Returns the inode for SECTOR in OPEN_INODES, open or not, or a null
+ * pointer.  OPEN_INODES_LOCK must be held. */
+static struct inode *
+find_open_inode (disk_sector_t sector) {
+	struct inode key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&open_inodes_lock));
+
+	key.sector = sector;
+	e = hash_find (&open_inodes, &key.elem);
+	return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
+/* Adds an opener to INODE, taking it off the unused list if it was
+ * closed.  OPEN_INODES_LOCK must be held. */
+static void
+get_inode (struct inode *inode) {
+	ASSERT (lock_held_by_current_thread (&open_inodes_lock));
+
+	if (inode->open_cnt++ == 0) {
+		list_remove (&inode->lru_elem);
+		unused_cnt--;
+	}
+}
+
+/* Returns INODE's delayed sector for file sector SECTOR_IDX, or a null
+ * pointer.  INODE's lock must be held. */
+static struct delayed_sector *
+find_delayed (struct inode *inode, size_t sector_idx) {
+	struct list_elem *e;
+
+	for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+			e = list_next (e)) {
+		struct delayed_sector *d = list_entry (e, struct delayed_sector, elem);
+		if (d->sector_idx >= sector_idx)
+			return d->sector_idx == sector_idx ? d : NULL;
+	}
+	return NULL;
+}
+
+/* Returns a new, zeroed delayed sector for file sector SECTOR_IDX of
+ * INODE, which must lie in a hole and not have one yet, with a disk
+ * sector reserved for it.  Returns a null pointer if the disk is full
+ * or memory runs out.  INODE's lock must be held. */
+static struct delayed_sector *
+add_delayed (struct inode *inode, size_t sector_idx) {
+	struct delayed_sector *d;
+	struct list_elem *e;
+
+	if (!free_map_reserve (1))
+		return NULL;
+	d = calloc (1, sizeof *d);
+	if (d == NULL) {
+		free_map_unreserve (1);
+		return NULL;
+	}
+	d->sector_idx = sector_idx;
+
+	for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+			e = list_next (e))
+		if (list_entry (e, struct delayed_sector, elem)->sector_idx > sector_idx)
+			break;
+	list_insert (e, &d->elem);
+	if (inode->delayed_cnt++ == 0) {
+		lock_acquire (&open_inodes_lock);
+		list_push_back (&delayed_inodes, &inode->delayed_elem);
+		lock_release (&open_inodes_lock);
+	}
+	return d;
+}
+
+/* Frees all of INODE's delayed sectors, without writing them, and
+ * withdraws their reservations.  OPEN_INODES_LOCK must be held, and
+ * INODE's lock too unless nobody else can reach INODE. */
+static void
+discard_delayed (struct inode *inode) {
+	ASSERT (lock_held_by_current_thread (&open_inodes_lock));
+
+	if (inode->delayed_cnt == 0)
+		return;
+	while (!list_empty (&inode->delayed))
+		free (list_entry (list_pop_front (&inode->delayed),
+					struct delayed_sector, elem));
+	free_map_unreserve (inode->delayed_cnt);
+	inode->delayed_cnt = 0;
+	list_remove (&inode->delayed_elem);
+}
+
+/* Allocates disk sectors for all of INODE's delayed sectors and writes
+ * them to the buffer cache.  Consecutive delayed sectors are allocated
+ * together, right after the data before them when possible.  Returns
+ * true if successful.  If the extent map fills up, or the disk does
+ * despite the reservations, the sectors that could not be placed are
+ * lost and false is returned.  INODE's lock must be held. */
+static bool
+flush_delayed (struct inode *inode) {
+	bool success = true;
+
+	ASSERT (lock_held_by_current_thread (&inode->lock));
+
+	if (inode->delayed_cnt == 0)
+		return true;
+
+	/* The reserved sectors are now about to be allocated. */
+	free_map_unreserve (inode->delayed_cnt);
+	while (!list_empty (&inode->delayed)) {
+		struct list_elem *e = list_begin (&inode->delayed);
+		size_t first = list_entry (e, struct delayed_sector, elem)->sector_idx;
+		disk_sector_t sector;
+		size_t cnt, i;
+
+		/* Count the consecutive delayed sectors starting at FIRST. */
+		for (cnt = 1; list_next (e) != list_end (&inode->delayed); cnt++) {
+			e = list_next (e);
+			if (list_entry (e, struct delayed_sector, elem)->sector_idx
+					!= first + cnt)
+				break;
+		}
+
+		cnt = fill_hole (inode, first, cnt, &sector);
+		if (cnt == 0) {
+			success = false;
+			break;
+		}
+		for (i = 0; i < cnt; i++) {
+			struct delayed_sector *d = list_entry (
+					list_pop_front (&inode->delayed), struct delayed_sector, elem);
+			write_data (inode, sector + i, d->data, 0, DISK_SECTOR_SIZE);
+			free (d);
+		}
+		inode->delayed_cnt -= cnt;
+	}
+	inode_flush (inode);
+
+	lock_acquire (&open_inodes_lock);
+	if (!success) {
+		/* discard_delayed() would withdraw the reservations again. */
+		while (!list_empty (&inode->delayed))
+			free (list_entry (list_pop_front (&inode->delayed),
+						struct delayed_sector, elem));
+		inode->delayed_cnt = 0;
+	}
+	list_remove (&inode->delayed_elem);
+	lock_release (&open_inodes_lock);
+	return success;
+}
+
+/* Frees in-memory INODE. */
+static void
+free_inode (struct inode *inode) {
+	ASSERT (inode->delayed_cnt == 0);
+	free (inode->inline_data);
+	free (inode->runs);
+	free (inode);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * disk.
+ * disk.  The data starts out as zeros stored in the inode if it fits,
+ * or else as a hole: disk sectors are allocated as it is written, and
+ * parts that are never written read as zeros without taking disk
+ * space.
  * Returns true if successful.
- * Returns false if memory or disk allocation fails. */
+ * Returns false if memory allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
+	struct inode *inode;
 	bool success = false;
 
 	ASSERT (length >= 0);
@@ -75,22 +673,36 @@ inode_create (disk_sector_t sector, off_t length) {
 	 * one sector in size, and you should fix that. */
 	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
+	/* Forget a closed inode that used to live at SECTOR. */
+	lock_acquire (&open_inodes_lock);
+	inode = find_open_inode (sector);
+	if (inode != NULL) {
+		ASSERT (inode->open_cnt == 0);
+		hash_delete (&open_inodes, &inode->elem);
+		list_remove (&inode->lru_elem);
+		unused_cnt--;
+	}
+	lock_release (&open_inodes_lock);
+	if (inode != NULL)
+		free_inode (inode);
+
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
 		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
+		if (length <= (off_t) INLINE_MAX)
+			disk_inode->flags = INODE_INLINE;
+		else {
+			disk_inode->sector_cnt = sectors;
+			disk_inode->extent_cnt = 1;
+			disk_inode->extents[0].start = 0;
+			disk_inode->extents[0].length = sectors;
+		}
+		journal_begin ();
+		journal_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+		journal_end ();
+		success = true;
 		free (disk_inode);
 	}
 	return success;
@@ -101,39 +713,63 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
-	struct inode *inode;
+	struct inode *inode, *other;
 
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	lock_acquire (&open_inodes_lock);
+	inode = find_open_inode (sector);
+	if (inode != NULL) {
+		get_inode (inode);
+		lock_release (&open_inodes_lock);
+		return inode;
 	}
+	lock_release (&open_inodes_lock);
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
 	if (inode == NULL)
 		return NULL;
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize.  The inode is read without holding the table lock, so
+	 * that opens of other inodes need not wait for the disk. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->metadata = false;
+	lock_init (&inode->lock);
+	list_init (&inode->delayed);
+	inode->delayed_cnt = 0;
+	/* It may have been created by the running transaction. */
+	inode->meta_txn = inode->data_txn = journal_txn ();
+	inode->data_dirty = false;
+	if (!inode_load (inode)) {
+		free_inode (inode);
+		return NULL;
+	}
+
+	/* Someone else may have opened it meanwhile. */
+	lock_acquire (&open_inodes_lock);
+	other = find_open_inode (sector);
+	if (other != NULL) {
+		get_inode (other);
+		lock_release (&open_inodes_lock);
+		free_inode (inode);
+		return other;
+	}
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -143,29 +779,82 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
-/* Closes INODE and writes it to disk.
- * If this was the last reference to INODE, frees its memory.
- * If INODE was also a removed inode, frees its blocks. */
+/* Closes INODE.
+ * If this was the last reference to INODE, writes its delayed sectors to
+ * the buffer cache and keeps it among the recently closed inodes,
+ * freeing the least recently closed one if there are too many.  If
+ * INODE was also a removed inode, frees it and its blocks instead. */
 void
 inode_close (struct inode *inode) {
+	struct inode *victim = NULL;
+	bool began = false;
+
 	/* Ignore null pointer. */
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
-
-		/* Deallocate blocks if removed. */
-		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+	for (;;) {
+		lock_acquire (&open_inodes_lock);
+		if (inode->open_cnt > 1) {
+			inode->open_cnt--;
+			lock_release (&open_inodes_lock);
+			if (began)
+				journal_end ();
+			return;
+		}
+		if (!began && (inode->removed || inode->delayed_cnt > 0)) {
+			/* Freeing or writing back sectors needs a journal handle,
+			 * and one must not be started with a lock held. */
+			lock_release (&open_inodes_lock);
+			journal_begin ();
+			began = true;
+			continue;
 		}
+		if (inode->removed || inode->delayed_cnt == 0)
+			break;
 
-		free (inode); 
+		/* Write back delayed sectors while still holding a reference,
+		 * then try again. */
+		lock_release (&open_inodes_lock);
+		lock_acquire (&inode->lock);
+		flush_delayed (inode);
+		lock_release (&inode->lock);
 	}
+	inode->open_cnt--;
+
+	/* Release resources if this was the last opener of a removed
+	 * inode. */
+	if (inode->removed) {
+		hash_delete (&open_inodes, &inode->elem);
+		discard_delayed (inode);
+		lock_release (&open_inodes_lock);
+
+		free_map_release (inode->sector, 1);
+		release_extents (inode);
+		journal_end ();
+		free_inode (inode);
+		return;
+	}
+
+	list_push_back (&unused_inodes, &inode->lru_elem);
+	if (++unused_cnt > UNUSED_INODE_MAX) {
+		victim = list_entry (list_pop_front (&unused_inodes),
+				struct inode, lru_elem);
+		hash_delete (&open_inodes, &victim->elem);
+		unused_cnt--;
+	}
+	lock_release (&open_inodes_lock);
+	if (began)
+		journal_end ();
+	if (victim != NULL)
+		free_inode (victim);
+}
+
+/* Marks INODE as holding file system metadata, such as a directory, so
+ * that its data is written through the journal. */
+void
+inode_set_metadata (struct inode *inode) {
+	inode->metadata = true;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -176,6 +865,80 @@ inode_remove (struct inode *inode) {
 	inode->removed = true;
 }
 
+/* Allocates a disk sector for file sector SECTOR_IDX of metadata INODE,
+ * which must lie in a hole, and writes SIZE bytes from BUFFER at offset
+ * OFS of it, the rest reading as zeros.  Metadata is written through
+ * the journal by the operation that changes it, so it is never
+ * delayed.  Returns false if the disk or the extent map is full.
+ * INODE's lock must be held. */
+static bool
+fill_metadata_hole (struct inode *inode, size_t sector_idx,
+		const void *buffer, int ofs, int size) {
+	disk_sector_t sector;
+
+	ASSERT (inode->metadata);
+
+	if (fill_hole (inode, sector_idx, 1, &sector) == 0)
+		return false;
+	write_data (inode, sector, zeros, 0, DISK_SECTOR_SIZE);
+	write_data (inode, sector, buffer, ofs, size);
+	return true;
+}
+
+/* Moves the data of inline INODE out of the inode into a delayed sector,
+ * or straight to disk if INODE holds metadata, so that INODE can grow
+ * past INLINE_MAX bytes.  Returns false if the disk is full or memory
+ * runs out.  INODE's lock must be held. */
+static bool
+move_inline (struct inode *inode) {
+	struct delayed_sector *d = NULL;
+
+	ASSERT (lock_held_by_current_thread (&inode->lock));
+	ASSERT (inode->inline_data != NULL);
+
+	if (!extend_extents (inode, bytes_to_sectors (inode->length)))
+		return false;
+	if (inode->length > 0 && inode->metadata) {
+		if (!fill_metadata_hole (inode, 0, inode->inline_data, 0,
+					inode->length)) {
+			inode->extent_cnt = inode->sector_cnt = 0;
+			return false;
+		}
+	} else if (inode->length > 0) {
+		d = add_delayed (inode, 0);
+		if (d == NULL) {
+			inode->extent_cnt = inode->sector_cnt = 0;
+			return false;
+		}
+		memcpy (d->data, inode->inline_data, inode->length);
+	}
+	free (inode->inline_data);
+	inode->inline_data = NULL;
+	inode->data_dirty = true;
+	return true;
+}
+
+/* Reads SIZE bytes at offset OFS of file sector SECTOR_IDX of INODE into
+ * BUFFER, for a sector that was found in a hole: from its delayed
+ * sector if it has one, as zeros if not.  The sector may have been
+ * allocated since, so this looks again. */
+static void
+read_hole (struct inode *inode, size_t sector_idx, void *buffer, int ofs,
+		int size) {
+	struct delayed_sector *d;
+	disk_sector_t sector;
+
+	lock_acquire (&inode->lock);
+	sector = idx_to_sector (inode, sector_idx);
+	if (sector != 0)
+		buffer_cache_read_at (sector, buffer, ofs, size);
+	else if ((d = find_delayed (inode, sector_idx)) != NULL)
+		memcpy (buffer, d->data + ofs, size);
+	else
+		memset (buffer, 0, size);
+	lock_release (&inode->lock);
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
@@ -183,11 +946,22 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+
+	lock_acquire (&inode->lock);
+	if (inode->inline_data != NULL) {
+		if (offset < inode->length) {
+			bytes_read = inode->length - offset < size
+				? inode->length - offset : size;
+			memcpy (buffer, inode->inline_data + offset, bytes_read);
+		}
+		lock_release (&inode->lock);
+		return bytes_read;
+	}
+	lock_release (&inode->lock);
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx;
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -200,81 +974,236 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
+		/* Only offsets before end of file are in the extent map. */
+		sector_idx = byte_to_sector (inode, offset);
+
+		if (sector_idx != 0)
+			buffer_cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
+		else
+			read_hole (inode, offset / DISK_SECTOR_SIZE, buffer + bytes_read,
+					sector_ofs, chunk_size);
+
+		/* Advance. */
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_read += chunk_size;
+	}
+
+	return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET,
+ * like inode_read_at(), for data that will be read only once.  Whole
+ * sectors that are stored together and not cached are read straight
+ * from disk, a run at a time, without passing through the cache.
+ * Returns the number of bytes actually read. */
+off_t
+inode_read_stream (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+
+	while (size > 0) {
+		/* Bytes left in inode, whole sectors left in the read. */
+		off_t inode_left = inode_length (inode) - offset;
+		size_t sectors_left = (size < inode_left ? size : inode_left)
+			/ DISK_SECTOR_SIZE;
+		disk_sector_t sector = 0;
+		size_t cnt = 0;
+		off_t chunk_size;
+
+		if (inode_left <= 0)
+			break;
+		if (offset % DISK_SECTOR_SIZE == 0 && sectors_left > 0) {
+			lock_acquire (&inode->lock);
+			if (inode->inline_data == NULL) {
+				size_t sector_idx = offset / DISK_SECTOR_SIZE;
+				size_t first;
+				struct extent ext = get_extent (inode,
+						find_extent (inode, sector_idx, &first));
+
+				if (ext.start != 0) {
+					sector = ext.start + (sector_idx - first);
+					cnt = ext.length - (sector_idx - first);
+					if (cnt > sectors_left)
+						cnt = sectors_left;
+				}
 			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+			lock_release (&inode->lock);
+		}
+
+		if (cnt > 0) {
+			buffer_cache_read_multi (sector, cnt, buffer + bytes_read);
+			chunk_size = cnt * DISK_SECTOR_SIZE;
+		} else {
+			/* Partial sectors, holes and inline data. */
+			chunk_size = DISK_SECTOR_SIZE - offset % DISK_SECTOR_SIZE;
+			if (chunk_size > size)
+				chunk_size = size;
+			chunk_size = inode_read_at (inode, buffer + bytes_read, chunk_size,
+					offset);
+			if (chunk_size == 0)
+				break;
 		}
 
-		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Starts reading the sectors holding the SIZE bytes of INODE at OFFSET
+ * into the buffer cache in the background, stopping at end of file. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end = offset + size;
+
+	/* Inline data is read along with the inode.  An inode never moves
+	 * back to being inline, so checking without the lock is safe. */
+	if (inode->inline_data != NULL)
+		return;
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	for (offset -= offset % DISK_SECTOR_SIZE; offset < end;
+			offset += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector (inode, offset);
+		if (sector != 0)
+			buffer_cache_prefetch (sector);
+	}
+}
+
+/* Writes SIZE bytes at offset OFS of file sector SECTOR_IDX of INODE
+ * from BUFFER, for a sector that was found in a hole: into its delayed
+ * sector, which is created if need be, or into a new disk sector if
+ * INODE holds metadata.  The sector may have been allocated since, so
+ * this looks again.  Returns false if the disk is full or memory runs
+ * out. */
+static bool
+write_hole (struct inode *inode, size_t sector_idx, const void *buffer,
+		int ofs, int size) {
+	struct delayed_sector *d = NULL;
+	disk_sector_t sector;
+	bool began = false;
+	bool success = true;
+
+	lock_acquire (&inode->lock);
+	sector = idx_to_sector (inode, sector_idx);
+	if (sector == 0 && inode->metadata) {
+		success = fill_metadata_hole (inode, sector_idx, buffer, ofs, size);
+		lock_release (&inode->lock);
+		return success;
+	}
+	if (sector == 0)
+		d = find_delayed (inode, sector_idx);
+	if (sector == 0 && d == NULL && inode->delayed_cnt >= DELAYED_MAX
+			&& thread_current ()->journal_depth == 0) {
+		/* Writing back the delayed sectors allocates, which needs a
+		 * journal handle, and one must not be started with INODE's lock
+		 * held. */
+		lock_release (&inode->lock);
+		journal_begin ();
+		began = true;
+		lock_acquire (&inode->lock);
+		sector = idx_to_sector (inode, sector_idx);
+		if (sector == 0)
+			d = find_delayed (inode, sector_idx);
+	}
+
+	if (sector != 0)
+		write_data (inode, sector, buffer, ofs, size);
+	else {
+		if (d == NULL && inode->delayed_cnt >= DELAYED_MAX)
+			flush_delayed (inode);
+		if (d == NULL)
+			d = add_delayed (inode, sector_idx);
+		if (d != NULL)
+			memcpy (d->data + ofs, buffer, size);
+		else
+			success = false;
+	}
+	lock_release (&inode->lock);
+	if (began)
+		journal_end ();
+	return success;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode; any gap between the old
+ * end of file and OFFSET is left as a hole.
+ * Data written into a hole is buffered in memory and only allocated
+ * disk sectors when it is written back, by inode_close(),
+ * inode_flush_delayed_all(), or once DELAYED_MAX sectors pile up. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
+	off_t end = offset + size;
+	bool handle, grown, filled = false;
 
-	if (inode->deny_write_cnt)
+	if (inode->deny_write_cnt || size <= 0)
 		return 0;
 
+	/* Only a write that changes metadata needs a journal handle: one to
+	 * metadata or inline data, or past the end of the file or of its
+	 * extent map.  None of these can stop being so once it is not, so
+	 * the check needs no lock. */
+	handle = (inode->metadata || inode->inline_data != NULL
+			|| end > inode->length
+			|| bytes_to_sectors (end) > inode->sector_cnt);
+	if (handle)
+		journal_begin ();
+	lock_acquire (&inode->lock);
+	if (inode->inline_data != NULL && end <= (off_t) INLINE_MAX) {
+		memcpy (inode->inline_data + offset, buffer, size);
+		if (end > inode->length)
+			inode->length = end;
+		inode->data_dirty = true;
+		inode_flush (inode);
+		lock_release (&inode->lock);
+		journal_end ();
+		return size;
+	}
+	grown = (inode->inline_data != NULL
+			|| bytes_to_sectors (end) > inode->sector_cnt);
+	if ((inode->inline_data != NULL && !move_inline (inode))
+			|| !extend_extents (inode, bytes_to_sectors (end))) {
+		lock_release (&inode->lock);
+		if (handle)
+			journal_end ();
+		return 0;
+	}
+	lock_release (&inode->lock);
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		/* Bytes left in the write, bytes left in sector, lesser of the
+		 * two. */
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
+		int chunk_size = size < sector_left ? size : sector_left;
 
-		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
-			break;
-
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+		if (sector_idx == 0) {
+			/* Sectors released by the running journal transaction only
+			 * become free once it commits. */
+			if (!write_hole (inode, offset / DISK_SECTOR_SIZE,
+						buffer + bytes_written, sector_ofs, chunk_size)
+					&& !(free_map_reclaim ()
+						&& write_hole (inode, offset / DISK_SECTOR_SIZE,
+							buffer + bytes_written, sector_ofs, chunk_size)))
+				break;
+			filled = true;
 		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
+			/* The cache reads in the rest of a partly written sector. */
+			write_data (inode, sector_idx, buffer + bytes_written,
+					sector_ofs, chunk_size);
 		}
 
 		/* Advance. */
@@ -282,11 +1211,171 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+
+	/* Extend the file only once the data is there, so that a concurrent
+	 * reader never sees the new end of file before the data. */
+	lock_acquire (&inode->lock);
+	if (offset > inode->length) {
+		inode->length = offset;
+		inode->data_dirty = grown = true;
+	}
+	/* Metadata written into holes was given sectors. */
+	if (grown || (inode->metadata && filled))
+		inode_flush (inode);
+	lock_release (&inode->lock);
+	if (handle)
+		journal_end ();
 
 	return bytes_written;
 }
 
+/* Allocates and zeroes disk sectors for the SIZE bytes of INODE starting
+ * at OFFSET that lie in holes, extending INODE if they go past its end,
+ * so that later writes to them need no allocation.  The sectors are
+ * placed together, right after the data before them when possible.
+ * Returns true if successful, false if writes to INODE are denied or
+ * the disk or the extent map is full, in which case part of the range
+ * may have been allocated. */
+bool
+inode_reserve (struct inode *inode, off_t offset, off_t size) {
+	size_t sector_idx, end_idx;
+	bool success = false;
+
+	ASSERT (offset >= 0 && size >= 0);
+
+	if (inode->deny_write_cnt)
+		return false;
+	if (size == 0)
+		return true;
+
+	journal_begin ();
+	lock_acquire (&inode->lock);
+	end_idx = bytes_to_sectors (offset + size);
+	if (inode->inline_data != NULL) {
+		/* Inline data needs no disk space of its own. */
+		if (offset + size <= (off_t) INLINE_MAX) {
+			if (offset + size > inode->length) {
+				inode->length = offset + size;
+				inode->data_dirty = true;
+			}
+			success = true;
+			goto done;
+		}
+		if (!move_inline (inode))
+			goto done;
+	}
+	if (!flush_delayed (inode) || !extend_extents (inode, end_idx))
+		goto done;
+	for (sector_idx = offset / DISK_SECTOR_SIZE; sector_idx < end_idx; ) {
+		disk_sector_t sector;
+		size_t cnt, i;
+
+		if (idx_to_sector (inode, sector_idx) != 0) {
+			sector_idx++;
+			continue;
+		}
+		cnt = fill_hole (inode, sector_idx, end_idx - sector_idx, &sector);
+		if (cnt == 0)
+			goto done;
+		for (i = 0; i < cnt; i++)
+			write_data (inode, sector + i, zeros, 0, DISK_SECTOR_SIZE);
+		sector_idx += cnt;
+	}
+	if (offset + size > inode->length) {
+		inode->length = offset + size;
+		inode->data_dirty = true;
+	}
+	success = true;
+
+done:
+	inode_flush (inode);
+	lock_release (&inode->lock);
+	journal_end ();
+	return success;
+}
+
+/* Writes the delayed sectors of all inodes to the buffer cache. */
+void
+inode_flush_delayed_all (void) {
+	for (;;) {
+		struct inode *inode;
+
+		lock_acquire (&open_inodes_lock);
+		if (list_empty (&delayed_inodes)) {
+			lock_release (&open_inodes_lock);
+			break;
+		}
+		inode = list_entry (list_front (&delayed_inodes), struct inode,
+				delayed_elem);
+		get_inode (inode);
+		lock_release (&open_inodes_lock);
+
+		journal_begin ();
+		lock_acquire (&inode->lock);
+		flush_delayed (inode);
+		lock_release (&inode->lock);
+		inode_close (inode);
+		journal_end ();
+	}
+}
+
+/* Makes the data written to INODE durable in dependency order: delayed
+ * data is given its sectors, the data sectors are written back, and
+ * then the journal transaction holding INODE's latest change commits,
+ * or if DATA_ONLY its latest change to the length, sectors or inline
+ * data, unless it has already.  The rest of the buffer cache is left
+ * alone.  Returns false if delayed data could not be placed. */
+static bool
+sync_inode (struct inode *inode, bool data_only) {
+	bool began = false;
+	uint32_t txn;
+	size_t idx;
+	bool success;
+
+	lock_acquire (&inode->lock);
+	if (inode->delayed_cnt > 0 && thread_current ()->journal_depth == 0) {
+		/* Placing delayed data allocates, which needs a journal handle,
+		 * and one must not be started with INODE's lock held. */
+		lock_release (&inode->lock);
+		journal_begin ();
+		began = true;
+		lock_acquire (&inode->lock);
+	}
+	success = flush_delayed (inode);
+	for (idx = 0; idx < inode->extent_cnt; idx++) {
+		struct extent ext = get_extent (inode, idx);
+		if (ext.start != 0)
+			buffer_cache_flush_range (ext.start, ext.length);
+	}
+	txn = data_only ? inode->data_txn : inode->meta_txn;
+	lock_release (&inode->lock);
+	if (began)
+		journal_end ();
+
+	/* The data of a metadata inode is itself in the journal. */
+	if (inode->metadata)
+		journal_commit ();
+	else
+		journal_commit_txn (txn);
+	return success;
+}
+
+/* Makes the data written to INODE durable, along with all of its
+ * metadata.  Returns false if delayed data could not be placed. */
+bool
+inode_sync (struct inode *inode) {
+	return sync_inode (inode, false);
+}
+
+/* Makes the data written to INODE durable, along with only the
+ * metadata needed to read it back: an overwrite in place that left the
+ * length and sectors alone commits nothing.  Returns false if delayed
+ * data could not be placed. */
+bool
+inode_datasync (struct inode *inode) {
+	return sync_inode (inode, true);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
@@ -309,5 +1398,5 @@ inode_allow_write (struct inode *inode) {
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
-	return inode->data.length;
+	return inode->length;
 }
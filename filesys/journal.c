@@ -0,0 +1,403 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/buffer-cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identify the journal header and transaction descriptor. */
+#define HEADER_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x4a445343
+
+/* Layout of the journal. */
+#define HEADER_SECTOR JOURNAL_SECTOR        /* Header. */
+#define DESC_SECTOR (JOURNAL_SECTOR + 1)    /* Transaction descriptor. */
+#define LOG_SECTOR (JOURNAL_SECTOR + 2)     /* Transaction's sectors. */
+
+/* Journal header.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_header {
+	unsigned magic;                     /* Magic number. */
+	uint32_t seq;                       /* Next transaction's number. */
+	uint8_t unused[DISK_SECTOR_SIZE - 8];   /* Not used. */
+};
+
+/* Descriptor of the last committed transaction.  It is written after the
+ * transaction's sectors, and the header is advanced past it once they
+ * have all reached their home sectors, so a descriptor whose SEQ matches
+ * the header's describes a complete transaction that may still need to
+ * be redone.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_desc {
+	unsigned magic;                     /* Magic number. */
+	uint32_t seq;                       /* Transaction number. */
+	uint32_t cnt;                       /* Number of sectors. */
+	disk_sector_t sectors[JOURNAL_TXN_MAX]; /* Home of each logged sector. */
+	uint8_t unused[DISK_SECTOR_SIZE - 12
+		- JOURNAL_TXN_MAX * sizeof (disk_sector_t)];  /* Not used. */
+};
+
+static bool active;                     /* Journaling writes? */
+static uint32_t seq;                    /* Running transaction's number. */
+
+/* Sectors changed by the running transaction. */
+static disk_sector_t txn_sectors[JOURNAL_TXN_MAX];
+static size_t txn_cnt;
+
+/* Sectors set aside by journal_extend() since the last commit, beyond
+ * the JOURNAL_OP_MAX each operation in progress has. */
+static size_t extra_cnt;
+
+/* Operations in progress.  A commit waits for them to finish and keeps
+ * new ones from starting, so that it sees every operation either whole
+ * or not at all.  The committing thread alone touches TXN_SECTORS,
+ * TXN_CNT and EXTRA_CNT while COMMITTING is true. */
+static int handle_cnt;
+static bool committing;
+static struct lock journal_lock;        /* Protects all of the above. */
+static struct condition handles_done;   /* Signaled when HANDLE_CNT is 0. */
+static struct condition commit_done;    /* Signaled when a commit ends. */
+
+/* Statistics. */
+static long long commit_cnt;            /* Transactions committed. */
+static long long logged_cnt;            /* Sectors written to the log. */
+
+/* Initializes the journal.  Writes pass straight to the buffer cache
+ * until journal_recover() is called. */
+void
+journal_init (void) {
+	lock_init (&journal_lock);
+	cond_init (&handles_done);
+	cond_init (&commit_done);
+	active = false;
+	txn_cnt = 0;
+	extra_cnt = 0;
+	handle_cnt = 0;
+	committing = false;
+}
+
+/* Writes an empty journal to the file system disk. */
+void
+journal_create (void) {
+	struct journal_header *header = calloc (1, sizeof *header);
+	struct journal_desc *desc = calloc (1, sizeof *desc);
+
+	ASSERT (sizeof *header == DISK_SECTOR_SIZE);
+	ASSERT (sizeof *desc == DISK_SECTOR_SIZE);
+
+	if (header == NULL || desc == NULL)
+		PANIC ("journal creation failed");
+	header->magic = HEADER_MAGIC;
+	header->seq = 1;
+	disk_write (filesys_disk, DESC_SECTOR, desc);
+	disk_write (filesys_disk, HEADER_SECTOR, header);
+	free (desc);
+	free (header);
+}
+
+/* Reads the journal from the file system disk and redoes the last
+ * committed transaction if it did not finish, then starts journaling
+ * writes.  Must be called before anything reads metadata. */
+void
+journal_recover (void) {
+	struct journal_header *header = malloc (sizeof *header);
+	struct journal_desc *desc = malloc (sizeof *desc);
+
+	if (header == NULL || desc == NULL)
+		PANIC ("journal recovery failed");
+	disk_read (filesys_disk, HEADER_SECTOR, header);
+	if (header->magic != HEADER_MAGIC)
+		PANIC ("file system has no journal; reformat it");
+	disk_read (filesys_disk, DESC_SECTOR, desc);
+
+	if (desc->magic == DESC_MAGIC && desc->seq == header->seq
+			&& desc->cnt <= JOURNAL_TXN_MAX) {
+		uint8_t *data = malloc (desc->cnt * DISK_SECTOR_SIZE);
+		size_t i;
+
+		if (data == NULL)
+			PANIC ("journal recovery failed");
+		printf ("Redoing %"PRIu32" journaled sectors...\n", desc->cnt);
+		disk_read_multi (filesys_disk, LOG_SECTOR, desc->cnt, data);
+		for (i = 0; i < desc->cnt; i++)
+			buffer_cache_write (desc->sectors[i], data + i * DISK_SECTOR_SIZE);
+		buffer_cache_flush ();
+		free (data);
+
+		header->seq++;
+		disk_write (filesys_disk, HEADER_SECTOR, header);
+	}
+
+	lock_acquire (&journal_lock);
+	seq = header->seq;
+	active = true;
+	lock_release (&journal_lock);
+	free (desc);
+	free (header);
+}
+
+/* Writes the running transaction to the log, then to its home sectors,
+ * then retires it.  Only the committing thread may call this. */
+static void
+write_txn (void) {
+	struct journal_header *header = calloc (1, sizeof *header);
+	struct journal_desc *desc = calloc (1, sizeof *desc);
+	uint8_t *data = malloc (txn_cnt * DISK_SECTOR_SIZE);
+	size_t i;
+
+	ASSERT (committing);
+
+	if (header == NULL || desc == NULL || data == NULL)
+		PANIC ("out of memory committing journal");
+
+	/* Log the sectors, then the descriptor that makes them count. */
+	for (i = 0; i < txn_cnt; i++)
+		buffer_cache_read (txn_sectors[i], data + i * DISK_SECTOR_SIZE);
+	disk_write_multi (filesys_disk, LOG_SECTOR, txn_cnt, data);
+	desc->magic = DESC_MAGIC;
+	desc->seq = seq;
+	desc->cnt = txn_cnt;
+	memcpy (desc->sectors, txn_sectors, txn_cnt * sizeof *txn_sectors);
+	disk_write (filesys_disk, DESC_SECTOR, desc);
+
+	/* Write the sectors home, then advance the header past the
+	 * transaction so that it is never redone over later changes. */
+	for (i = 0; i < txn_cnt; i++)
+		buffer_cache_release (txn_sectors[i]);
+	header->magic = HEADER_MAGIC;
+	header->seq = ++seq;
+	disk_write (filesys_disk, HEADER_SECTOR, header);
+
+	commit_cnt++;
+	logged_cnt += txn_cnt;
+	txn_cnt = 0;
+	extra_cnt = 0;
+	free (data);
+	free (desc);
+	free (header);
+}
+
+/* Commits the changed parts of the free map in transactions of their
+ * own, as many as they take.  Only the committing thread may call this,
+ * with the running transaction empty. */
+static void
+commit_free_map (void) {
+	ASSERT (committing);
+	ASSERT (txn_cnt == 0);
+
+	while (free_map_dirty_cnt () > 0) {
+		free_map_flush (JOURNAL_TXN_MAX);
+		write_txn ();
+	}
+}
+
+/* Commits the running transaction.  Waits for operations in progress to
+ * finish first.  JOURNAL_LOCK must be held, and no other commit may be
+ * in progress. */
+static void
+commit (void) {
+	static disk_sector_t saved_sectors[JOURNAL_TXN_MAX];
+	struct thread *curr = thread_current ();
+	size_t saved_cnt;
+
+	ASSERT (lock_held_by_current_thread (&journal_lock));
+	ASSERT (!committing);
+	ASSERT (curr->journal_depth == 0);
+
+	committing = true;
+	while (handle_cnt > 0)
+		cond_wait (&handles_done, &journal_lock);
+	lock_release (&journal_lock);
+
+	/* Add the free map changes of the transaction's operations to it,
+	 * writing through the journal like an operation would.  If they do
+	 * not fit, commit them first, on their own: the free map on disk
+	 * then marks sectors in use before the metadata that uses them
+	 * reaches the disk, which after a crash can only leak them. */
+	curr->journal_depth++;
+	if (free_map_dirty_cnt () <= JOURNAL_TXN_MAX - txn_cnt)
+		free_map_flush (JOURNAL_TXN_MAX - txn_cnt);
+	else {
+		saved_cnt = txn_cnt;
+		memcpy (saved_sectors, txn_sectors, saved_cnt * sizeof *txn_sectors);
+		txn_cnt = 0;
+		commit_free_map ();
+		memcpy (txn_sectors, saved_sectors, saved_cnt * sizeof *txn_sectors);
+		txn_cnt = saved_cnt;
+	}
+
+	if (txn_cnt > 0) {
+		/* Write file data first, so that committed metadata never points
+		 * to sectors whose data is not on disk yet. */
+		buffer_cache_flush ();
+		write_txn ();
+	}
+
+	/* Sectors the transaction released can be used again now, and the
+	 * free map is updated to match in transactions of its own. */
+	free_map_commit ();
+	commit_free_map ();
+	curr->journal_depth--;
+
+	lock_acquire (&journal_lock);
+	committing = false;
+	cond_broadcast (&commit_done, &journal_lock);
+}
+
+/* Returns true if the running transaction has room for CNT more sectors
+ * beyond those set aside for the operations in progress.  JOURNAL_LOCK
+ * must be held. */
+static bool
+txn_has_room (size_t cnt) {
+	ASSERT (lock_held_by_current_thread (&journal_lock));
+
+	return txn_cnt + handle_cnt * JOURNAL_OP_MAX + extra_cnt + cnt
+		<= JOURNAL_TXN_MAX;
+}
+
+/* Starts an operation that changes metadata.  Operations may nest; only
+ * the outermost counts.  Must not be called with locks held that a
+ * commit might need, since this may wait for one to finish. */
+void
+journal_begin (void) {
+	struct thread *curr = thread_current ();
+
+	if (curr->journal_depth > 0) {
+		curr->journal_depth++;
+		return;
+	}
+
+	lock_acquire (&journal_lock);
+	while (committing)
+		cond_wait (&commit_done, &journal_lock);
+
+	/* Commit early unless the transaction has room for one more
+	 * operation's worth of sectors. */
+	if (active && !txn_has_room (JOURNAL_OP_MAX))
+		commit ();
+	handle_cnt++;
+	lock_release (&journal_lock);
+	curr->journal_depth = 1;
+}
+
+/* Ends an operation started by journal_begin(). */
+void
+journal_end (void) {
+	struct thread *curr = thread_current ();
+
+	ASSERT (curr->journal_depth > 0);
+	if (--curr->journal_depth > 0)
+		return;
+
+	lock_acquire (&journal_lock);
+	if (--handle_cnt == 0)
+		cond_broadcast (&handles_done, &journal_lock);
+	lock_release (&journal_lock);
+}
+
+/* Sets aside CNT more sectors of the running transaction for the
+ * calling operation, which is about to change more than JOURNAL_OP_MAX
+ * sectors.  Returns false if the transaction has no room for them, in
+ * which case the operation must not make the changes. */
+bool
+journal_extend (size_t cnt) {
+	bool success = true;
+
+	lock_acquire (&journal_lock);
+	if (active) {
+		ASSERT (thread_current ()->journal_depth > 0);
+		success = txn_has_room (cnt);
+		if (success)
+			extra_cnt += cnt;
+	}
+	lock_release (&journal_lock);
+	return success;
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS of metadata sector
+ * SECTOR, as part of the running transaction.  The sector is held in the
+ * buffer cache until the transaction commits.  Must be called between
+ * journal_begin() and journal_end(). */
+void
+journal_write (disk_sector_t sector, const void *buffer, size_t ofs,
+		size_t size) {
+	bool held = false;
+	size_t i;
+
+	ASSERT (thread_current ()->journal_depth > 0);
+
+	lock_acquire (&journal_lock);
+	if (active) {
+		for (i = 0; i < txn_cnt; i++)
+			if (txn_sectors[i] == sector)
+				break;
+		if (i == txn_cnt) {
+			if (txn_cnt == JOURNAL_TXN_MAX)
+				PANIC ("journal: operation changed more sectors than it set aside");
+			txn_sectors[txn_cnt++] = sector;
+		}
+		held = true;
+	}
+	lock_release (&journal_lock);
+
+	if (held)
+		buffer_cache_write_held (sector, buffer, ofs, size);
+	else
+		buffer_cache_write_at (sector, buffer, ofs, size);
+}
+
+/* Commits the running transaction, making every operation finished so
+ * far durable. */
+void
+journal_commit (void) {
+	lock_acquire (&journal_lock);
+	while (committing)
+		cond_wait (&commit_done, &journal_lock);
+	commit ();
+	lock_release (&journal_lock);
+}
+
+/* Returns the number of the running transaction, to which the changes
+ * of the operations in progress belong. */
+uint32_t
+journal_txn (void) {
+	uint32_t txn;
+
+	lock_acquire (&journal_lock);
+	txn = seq;
+	lock_release (&journal_lock);
+	return txn;
+}
+
+/* Commits transaction TXN, as returned by journal_txn(), unless it has
+ * committed already. */
+void
+journal_commit_txn (uint32_t txn) {
+	lock_acquire (&journal_lock);
+	while (committing)
+		cond_wait (&commit_done, &journal_lock);
+	if (seq == txn)
+		commit ();
+	lock_release (&journal_lock);
+}
+
+/* Commits the running transaction and stops journaling writes. */
+void
+journal_done (void) {
+	journal_commit ();
+	lock_acquire (&journal_lock);
+	active = false;
+	lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) {
+	printf ("Journal: %lld commits, %lld sectors logged\n",
+			commit_cnt, logged_cnt);
+}
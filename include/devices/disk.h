@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,6 +18,21 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* An asynchronous transfer of CNT sectors starting at SEC_NO
+ * between DISK and BUFFER.  COMPLETE is called from the disk's
+ * channel thread when the transfer is done. */
+struct disk_request {
+	struct list_elem elem;      /* Channel queue element. */
+	uint64_t seq;               /* Submission order, set by disk_submit(). */
+	struct disk *disk;
+	disk_sector_t sec_no;
+	size_t cnt;
+	void *buffer;
+	bool write;                 /* True to write BUFFER to the disk. */
+	void (*complete) (struct disk_request *);
+	void *aux;                  /* For use by COMPLETE. */
+};
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,6 +40,10 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multi (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multi (struct disk *, disk_sector_t, size_t cnt,
+		const void *);
+void disk_submit (struct disk_request *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
@@ -0,0 +1,24 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Write-behind cache of file system disk sectors. */
+
+void buffer_cache_init (void);
+void buffer_cache_read (disk_sector_t, void *);
+void buffer_cache_write (disk_sector_t, const void *);
+void buffer_cache_read_at (disk_sector_t, void *, size_t ofs, size_t size);
+void buffer_cache_read_multi (disk_sector_t, size_t cnt, void *);
+void buffer_cache_write_at (disk_sector_t, const void *, size_t ofs,
+		size_t size);
+void buffer_cache_write_held (disk_sector_t, const void *, size_t ofs,
+		size_t size);
+void buffer_cache_release (disk_sector_t);
+void buffer_cache_prefetch (disk_sector_t);
+void buffer_cache_flush (void);
+void buffer_cache_flush_range (disk_sector_t, size_t cnt);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer-cache.h */
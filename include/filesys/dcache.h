@@ -0,0 +1,20 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Cache of directory lookups: maps a directory's inode sector and a
+ * name to the inode sector the name refers to, or records that the
+ * name does not exist. */
+
+/* Inode sector recorded for a name known not to exist.  Sector 0 holds
+ * the free map inode, so it is never a directory entry. */
+#define DCACHE_NONE 0
+
+void dcache_init (void);
+bool dcache_lookup (disk_sector_t dir, const char *name, disk_sector_t *);
+void dcache_insert (disk_sector_t dir, const char *name, disk_sector_t);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
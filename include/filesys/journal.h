@@ -0,0 +1,52 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/disk.h"
+
+/* Write-ahead journal of file system metadata.
+ *
+ * Operations that change metadata run between journal_begin() and
+ * journal_end(), and write metadata sectors with journal_write().  The
+ * changes of all operations since the last commit form one transaction,
+ * which is committed as a whole: by the flush thread every few seconds,
+ * when it grows large, or by journal_commit().  Until then the changed
+ * sectors stay in the buffer cache.  Each operation in progress has
+ * JOURNAL_OP_MAX sectors of the transaction set aside for it, and one
+ * that changes more must ask for them with journal_extend() first, so
+ * that a transaction never runs out of room halfway through an
+ * operation.  After a crash, journal_recover() redoes the last committed
+ * transaction if it had not fully reached its home sectors, so that the
+ * metadata on disk always reflects a whole number of operations. */
+
+/* Most sectors in one transaction.  Must stay well below the number of
+ * sectors in the buffer cache, which holds them until commit. */
+#define JOURNAL_TXN_MAX 32
+
+/* Sectors of the running transaction set aside for each operation in
+ * progress: the most metadata sectors an operation may change without
+ * calling journal_extend().  The free map is not counted; its changes
+ * are committed separately. */
+#define JOURNAL_OP_MAX 8
+
+/* Sectors reserved for the journal, starting at JOURNAL_SECTOR: a header,
+ * a transaction descriptor and the transaction's sectors. */
+#define JOURNAL_SECTORS (2 + JOURNAL_TXN_MAX)
+
+void journal_init (void);
+void journal_create (void);
+void journal_recover (void);
+void journal_done (void);
+
+void journal_begin (void);
+void journal_end (void);
+bool journal_extend (size_t cnt);
+void journal_write (disk_sector_t, const void *, size_t ofs, size_t size);
+void journal_commit (void);
+uint32_t journal_txn (void);
+void journal_commit_txn (uint32_t txn);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
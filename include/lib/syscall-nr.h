@@ -36,6 +36,22 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Kernel tuning. */
+	SYS_VMTRACE,                /* Drain the VM event trace. */
+	SYS_PREALLOCATE,            /* Allocate disk space for a file. */
+
+	/* Positional and vectored I/O. */
+	SYS_PREAD,                  /* Read from a file at an offset. */
+	SYS_PWRITE,                 /* Write to a file at an offset. */
+	SYS_READV,                  /* Read from a file into several buffers. */
+	SYS_WRITEV,                 /* Write to a file from several buffers. */
+	SYS_COPY_FILE_RANGE,        /* Copy data from one file to another. */
+
+	/* Durability. */
+	SYS_FSYNC,                  /* Write a file's changes to disk. */
+	SYS_FDATASYNC,              /* Write a file's data to disk. */
+	SYS_SYNC,                   /* Write all file system changes to disk. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+
+/* Buffers for the readv() and writev() system calls, shared by the
+ * kernel and user programs. */
+
+/* Most buffers in one call. */
+#define IOV_MAX 64
+
+/* One buffer. */
+struct iovec {
+	void *iov_base;             /* Start of buffer. */
+	size_t iov_len;             /* Size in bytes. */
+};
+
+#endif /* lib/uio.h */
@@ -50,6 +50,25 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+/* Kernel tuning. */
+struct vmtrace_rec;
+size_t vmtrace (struct vmtrace_rec *buf, size_t max);
+bool preallocate (int fd, off_t offset, off_t length);
+
+/* Positional and vectored I/O. */
+struct iovec;
+int pread (int fd, void *buffer, unsigned length, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned length, off_t offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+		unsigned length);
+
+/* Durability. */
+int fsync (int fd);
+int fdatasync (int fd);
+void sync (void);
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
@@ -0,0 +1,42 @@
+#ifndef __LIB_VMTRACE_H
+#define __LIB_VMTRACE_H
+
+#include <stdint.h>
+
+/* Virtual memory trace records, shared by the kernel and the vmtrace()
+ * system call. */
+
+/* Kinds of events. */
+enum vmtrace_kind {
+	VMTRACE_FAULT,              /* Page fault. */
+	VMTRACE_EVICT,              /* Page evicted from its frame. */
+	VMTRACE_SWAP_IN,            /* Page read back from swap. */
+	VMTRACE_SWAP_OUT,           /* Page written to swap. */
+};
+
+/* Event flags. */
+#define VMTRACE_WRITE 0x01      /* Fault on a write access. */
+#define VMTRACE_FAILED 0x02     /* Fault that could not be handled. */
+#define VMTRACE_KSWAPD 0x04     /* Eviction by the swap daemon. */
+#define VMTRACE_ZSWAP 0x08      /* Swap I/O served by zswap, not disk. */
+#define VMTRACE_READAHEAD 0x10  /* Swap-in done as readahead. */
+
+/* Page types, as page_get_type() reports them. */
+#define VMTRACE_TYPE_UNINIT 0       /* Not initialized yet. */
+#define VMTRACE_TYPE_ANON 1         /* Anonymous page. */
+#define VMTRACE_TYPE_FILE 2         /* File-backed page. */
+#define VMTRACE_TYPE_PAGE_CACHE 3   /* Page cache page. */
+#define VMTRACE_TYPE_NONE 0xff      /* Fault on an address without a page. */
+
+/* One event. */
+struct vmtrace_rec {
+	uint64_t va;                /* Page address. */
+	int64_t time;               /* Timer tick when the event ended. */
+	int32_t cost;               /* Timer ticks the event took. */
+	int32_t tid;                /* Thread whose page it is. */
+	uint8_t kind;               /* One of enum vmtrace_kind. */
+	uint8_t type;               /* Page type, see page_get_type(). */
+	uint16_t flags;             /* VMTRACE_* flags. */
+};
+
+#endif /* lib/vmtrace.h */
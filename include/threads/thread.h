@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
+#include "threads/synch.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
@@ -114,10 +115,34 @@ struct thread {
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+	struct file *running_file;          /* Executable, kept open for lazy loading. */
+	struct file **fds;                  /* Open files by descriptor. */
+
+	/* Fork.  The parent waits on FORK_DONE while a child copies it, and
+	 * while initd starts. */
+	struct intr_frame *fork_if;         /* User context being cloned. */
+	struct semaphore fork_done;         /* Up'd when the child is set up. */
+	bool fork_success;                  /* Did the child set up? */
+
+	/* Exit and wait.  Only processes are put on their parent's CHILDREN,
+	 * and one that exits waits on REAPED until its parent has collected
+	 * EXIT_STATUS or exited itself. */
+	bool attached;                      /* On the parent's CHILDREN? */
+	int exit_status;                    /* Status passed to exit(). */
+	struct list children;               /* Children not yet waited for. */
+	struct list_elem child_elem;        /* Element in parent's CHILDREN. */
+	struct semaphore exited;            /* Up'd when the thread has exited. */
+	struct semaphore reaped;            /* Up'd when the parent is done. */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	void *stack_bottom;                 /* Lowest page of the user stack. */
+	void *user_rsp;                     /* User rsp on entry to the kernel. */
+#endif
+#ifdef FILESYS
+	/* Owned by filesys/journal.c. */
+	int journal_depth;                  /* Nesting of journal_begin(). */
 #endif
 
 	/* Owned by thread.c. */
@@ -3,6 +3,10 @@
 
 #include "threads/thread.h"
 
+/* Number of file descriptors per process.  Descriptors 0 and 1 are the
+ * console and never name a file. */
+#define FD_MAX 128
+
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
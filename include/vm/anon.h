@@ -3,10 +3,18 @@
 #include "vm/vm.h"
 struct page;
 enum vm_type;
+struct zswap_entry;
 
 struct anon_page {
+	size_t swap_slot;           /* Swap slot holding the page, if evicted. */
+	struct zswap_entry *zswap;  /* Compressed copy, if evicted to zswap. */
 };
 
+/* Number of swap slots around a faulting page's slot that are read
+ * along with it, if they hold pages of the same process.  Set by kernel
+ * command-line option "-swap-ra"; 0 disables swap readahead. */
+extern size_t anon_readahead_pages;
+
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
 
@@ -0,0 +1,14 @@
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+#include <stddef.h>
+#include <stdint.h>
+#include <vmtrace.h>
+
+struct page;
+
+void vm_trace_init (void);
+void vm_trace (enum vmtrace_kind kind, struct page *page, const void *va,
+		int flags, int64_t start);
+size_t vm_trace_drain (struct vmtrace_rec *buf, size_t max);
+
+#endif /* vm/trace.h */
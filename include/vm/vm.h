@@ -1,6 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -36,6 +38,9 @@ struct thread;
 
 #define VM_TYPE(type) ((type) & 7)
 
+/* Marker for anonymous pages that belong to the user stack. */
+#define VM_STACK VM_MARKER_0
+
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -46,6 +51,9 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct hash_elem spt_elem;  /* Element in supplemental_page_table. */
+	struct thread *owner;       /* Thread whose address space holds it. */
+	bool writable;              /* True if user may write to the page. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -63,6 +71,8 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list_elem elem;      /* Element in the frame table. */
+	bool pinned;                /* True while the frame must not be evicted. */
 };
 
 /* The function table for page operations.
@@ -85,8 +95,24 @@ struct page_operations {
  * We don't want to force you to obey any specific design for this struct.
  * All designs up to you for this. */
 struct supplemental_page_table {
+	struct hash pages;          /* Pages, keyed by user virtual address. */
 };
 
+/* Free user frame watermarks for the swap daemon, in pages.
+ * The daemon wakes when free frames drop below VM_WMARK_LOW and evicts
+ * until VM_WMARK_HIGH frames are free.  Set by kernel command-line
+ * options "-wmark-low" and "-wmark-high"; 0 picks a default from the
+ * size of the user pool. */
+extern size_t vm_wmark_low;
+extern size_t vm_wmark_high;
+
+/* User stack limits, in pages.  The stack grows on demand up to
+ * VM_STACK_LIMIT pages, and never to within VM_STACK_GAP pages of
+ * another mapping.  Set by kernel command-line options "-stack-limit"
+ * and "-stack-gap". */
+extern size_t vm_stack_limit;
+extern size_t vm_stack_gap;
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -100,6 +126,7 @@ void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
+bool vm_grow_stack (void *addr);
 
 #define vm_alloc_page(type, upage, writable) \
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
@@ -107,6 +134,8 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+struct frame *vm_prefetch_frame (struct page *page);
+bool vm_map_frame (struct page *page);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
@@ -0,0 +1,22 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed in-memory swap tier.  Anonymous pages being swapped out are
+ * compressed into kernel memory and only go to the swap disk if they do
+ * not compress well or the pool is over budget. */
+
+struct zswap_entry;
+
+/* Budget of the compressed pool, in pages of kernel memory.  Set by
+ * kernel command-line option "-zswap"; 0 disables the tier. */
+extern size_t zswap_budget;
+
+void zswap_init (void);
+struct zswap_entry *zswap_store (const void *kva);
+bool zswap_load (struct zswap_entry *entry, void *kva);
+void zswap_free (struct zswap_entry *entry);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */
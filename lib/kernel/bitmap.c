@@ -326,6 +326,22 @@ bitmap_write (const struct bitmap *b, struct file *file) {
 	off_t size = byte_cnt (b->bit_cnt);
 	return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B starting at byte OFS to the same
+   place in FILE, clipped to the size of B.  Return true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+		off_t ofs, off_t size) {
+	off_t total = byte_cnt (b->bit_cnt);
+
+	if (ofs >= total)
+		return true;
+	if (size > total - ofs)
+		size = total - ofs;
+	return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+		== size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -54,7 +54,7 @@ static __inline int64_t syscall (uint64_t num_, uint64_t a1_, uint64_t a2_,
 			((uint64_t) ARG2), 0, 0, 0))
 
 #define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3) ( \
-		syscall(((uint64_t *) NUMBER), \
+		syscall(((uint64_t) NUMBER), \
 			((uint64_t) ARG0), \
 			((uint64_t) ARG1), \
 			((uint64_t) ARG2), \
@@ -194,3 +194,55 @@ int
 umount (const char *path) {
 	return syscall1 (SYS_UMOUNT, path);
 }
+
+size_t
+vmtrace (struct vmtrace_rec *buf, size_t max) {
+	return syscall2 (SYS_VMTRACE, buf, max);
+}
+
+bool
+preallocate (int fd, off_t offset, off_t length) {
+	return syscall3 (SYS_PREALLOCATE, fd, offset, length);
+}
+
+int
+pread (int fd, void *buffer, unsigned length, off_t offset) {
+	return syscall4 (SYS_PREAD, fd, buffer, length, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned length, off_t offset) {
+	return syscall4 (SYS_PWRITE, fd, buffer, length, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt) {
+	return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt) {
+	return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+		unsigned length) {
+	return syscall5 (SYS_COPY_FILE_RANGE, fd_in, off_in, fd_out, off_out,
+			length);
+}
+
+int
+fsync (int fd) {
+	return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+fdatasync (int fd) {
+	return syscall1 (SYS_FDATASYNC, fd);
+}
+
+void
+sync (void) {
+	syscall0 (SYS_SYNC);
+}
@@ -0,0 +1,53 @@
+/* Copies with copy_file_range() from ranges that run past the end of
+   the source file, and checks that each copy stops at end of file and
+   reports and advances by only the bytes it copied, both through
+   offset pointers and through the file positions. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SRC_SIZE 1500
+
+static char src[SRC_SIZE];
+static char dst[800];
+
+void
+test_main (void) 
+{
+  off_t in, out;
+  int src_fd, dst_fd;
+
+  random_bytes (src, sizeof src);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src_fd = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src_fd, src, sizeof src) == sizeof src, "write \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((dst_fd = open ("dst")) > 1, "open \"dst\"");
+
+  in = 1000;
+  out = 0;
+  CHECK (copy_file_range (src_fd, &in, dst_fd, &out, 4096) == 500,
+         "copy across end of \"src\" returns 500");
+  CHECK (in == 1500 && out == 500, "offsets advance by 500");
+  CHECK (copy_file_range (src_fd, &in, dst_fd, &out, 4096) == 0,
+         "copy at end of \"src\" returns 0");
+  CHECK (in == 1500 && out == 500, "offsets are unchanged");
+  memcpy (dst, src + 1000, 500);
+
+  seek (src_fd, 1200);
+  seek (dst_fd, 500);
+  CHECK (copy_file_range (src_fd, NULL, dst_fd, NULL, 1000) == 300,
+         "copy across end of \"src\" at positions returns 300");
+  CHECK (tell (src_fd) == 1500 && tell (dst_fd) == 800,
+         "positions advance by 300");
+  memcpy (dst + 500, src + 1200, 300);
+
+  msg ("close \"src\"");
+  close (src_fd);
+  msg ("close \"dst\"");
+  close (dst_fd);
+  check_file ("dst", dst, sizeof dst);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-eof) begin
+(copy-eof) create "src"
+(copy-eof) open "src"
+(copy-eof) write "src"
+(copy-eof) create "dst"
+(copy-eof) open "dst"
+(copy-eof) copy across end of "src" returns 500
+(copy-eof) offsets advance by 500
+(copy-eof) copy at end of "src" returns 0
+(copy-eof) offsets are unchanged
+(copy-eof) copy across end of "src" at positions returns 300
+(copy-eof) positions advance by 300
+(copy-eof) close "src"
+(copy-eof) close "dst"
+(copy-eof) open "dst" for verification
+(copy-eof) verified contents of "dst"
+(copy-eof) close "dst"
+(copy-eof) end
+EOF
+pass;
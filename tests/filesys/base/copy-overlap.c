@@ -0,0 +1,49 @@
+/* Copies ranges of a file onto itself with copy_file_range(), and
+   checks that a copy whose source and destination overlap is refused
+   without touching the file or the offsets, while copies that do not
+   overlap, including one that grows the file, go through. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_SIZE 2000
+
+static const char file_name[] = "copy";
+static char buf[DATA_SIZE + 1000];
+
+void
+test_main (void) 
+{
+  off_t in, out;
+  int fd;
+
+  random_bytes (buf, DATA_SIZE);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, DATA_SIZE) == DATA_SIZE, "write \"%s\"", file_name);
+
+  in = 0;
+  out = 500;
+  CHECK (copy_file_range (fd, &in, fd, &out, 1000) == -1,
+         "overlapping copy is refused");
+  CHECK (in == 0 && out == 500, "offsets are unchanged");
+
+  CHECK (copy_file_range (fd, &in, fd, &out, 500) == 500,
+         "copy 500 bytes from offset 0 to 500");
+  CHECK (in == 500 && out == 1000, "offsets advance by 500");
+  memcpy (buf + 500, buf, 500);
+
+  in = 1000;
+  out = 2000;
+  CHECK (copy_file_range (fd, &in, fd, &out, 1000) == 1000,
+         "copy 1000 bytes from offset 1000 to end of file");
+  CHECK (in == 2000 && out == 3000, "offsets advance by 1000");
+  memcpy (buf + 2000, buf + 1000, 1000);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
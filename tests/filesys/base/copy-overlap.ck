@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-overlap) begin
+(copy-overlap) create "copy"
+(copy-overlap) open "copy"
+(copy-overlap) write "copy"
+(copy-overlap) overlapping copy is refused
+(copy-overlap) offsets are unchanged
+(copy-overlap) copy 500 bytes from offset 0 to 500
+(copy-overlap) offsets advance by 500
+(copy-overlap) copy 1000 bytes from offset 1000 to end of file
+(copy-overlap) offsets advance by 1000
+(copy-overlap) close "copy"
+(copy-overlap) open "copy" for verification
+(copy-overlap) verified contents of "copy"
+(copy-overlap) close "copy"
+(copy-overlap) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Syncs a file with fdatasync() after writes that place new data,
+   overwrite data in place, and grow the file, and checks that each
+   succeeds and that the data reads back, and that fdatasync() on a
+   descriptor that is not open fails. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 1500
+
+static const char file_name[] = "datasync";
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  CHECK (write (fd, buf, 1000) == 1000, "write 1000 bytes");
+  CHECK (fdatasync (fd) == 0, "fdatasync after writing new data");
+
+  random_bytes (buf + 200, 300);
+  CHECK (pwrite (fd, buf + 200, 300, 200) == 300,
+         "overwrite 300 bytes in place");
+  CHECK (fdatasync (fd) == 0, "fdatasync after overwriting");
+
+  CHECK (write (fd, buf + 1000, FILE_SIZE - 1000) == FILE_SIZE - 1000,
+         "write 500 more bytes");
+  CHECK (fdatasync (fd) == 0, "fdatasync after growing");
+  CHECK (fsync (fd) == 0, "fsync");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  CHECK (fdatasync (fd) == -1, "fdatasync on closed descriptor fails");
+  check_file (file_name, buf, sizeof buf);
+}
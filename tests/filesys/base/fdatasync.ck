@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fdatasync) begin
+(fdatasync) create "datasync"
+(fdatasync) open "datasync"
+(fdatasync) write 1000 bytes
+(fdatasync) fdatasync after writing new data
+(fdatasync) overwrite 300 bytes in place
+(fdatasync) fdatasync after overwriting
+(fdatasync) write 500 more bytes
+(fdatasync) fdatasync after growing
+(fdatasync) fsync
+(fdatasync) close "datasync"
+(fdatasync) fdatasync on closed descriptor fails
+(fdatasync) open "datasync" for verification
+(fdatasync) verified contents of "datasync"
+(fdatasync) close "datasync"
+(fdatasync) end
+EOF
+pass;
@@ -0,0 +1,70 @@
+/* Checks the accounting of free space around preallocation.  Finds
+   how much can be preallocated, then checks that removing the file
+   gives all of it back, that data written but not yet allocated on
+   disk keeps its space promised so preallocation cannot take it, and
+   that closing and removing that file returns the promise. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STEP 65536
+#define SMALL_SIZE (4 * STEP)
+
+static const char big_name[] = "big";
+static const char small_name[] = "small";
+static char buf[4096];
+
+/* Creates BIG_NAME and tries to preallocate SIZE bytes in it, then
+   removes it.  Returns true if the preallocation succeeded. */
+static bool
+try_preallocate (off_t size) 
+{
+  bool success;
+  int fd;
+
+  if (!create (big_name, 0))
+    fail ("create \"%s\"", big_name);
+  if ((fd = open (big_name)) < 2)
+    fail ("open \"%s\"", big_name);
+  success = preallocate (fd, 0, size);
+  close (fd);
+  if (!remove (big_name))
+    fail ("remove \"%s\"", big_name);
+  return success;
+}
+
+void
+test_main (void) 
+{
+  off_t cap = 0;
+  int fd, i;
+
+  /* Find about how much the disk can hold. */
+  CHECK (create (big_name, 0), "create \"%s\"", big_name);
+  CHECK ((fd = open (big_name)) > 1, "open \"%s\"", big_name);
+  while (preallocate (fd, cap, STEP))
+    cap += STEP;
+  msg ("close \"%s\"", big_name);
+  close (fd);
+  CHECK (remove (big_name), "remove \"%s\"", big_name);
+  CHECK (cap > SMALL_SIZE + STEP, "preallocated most of the disk");
+
+  for (i = 0; i < 3; i++)
+    CHECK (try_preallocate (cap - STEP),
+           "preallocate most of the disk again (%d)", i);
+
+  CHECK (create (small_name, 0), "create \"%s\"", small_name);
+  CHECK ((fd = open (small_name)) > 1, "open \"%s\"", small_name);
+  for (i = 0; i < SMALL_SIZE / (int) sizeof buf; i++)
+    if (write (fd, buf, sizeof buf) != sizeof buf)
+      fail ("write \"%s\"", small_name);
+  msg ("write \"%s\"", small_name);
+  CHECK (!try_preallocate (cap - STEP),
+         "preallocate fails while \"%s\" holds space", small_name);
+  msg ("close \"%s\"", small_name);
+  close (fd);
+  CHECK (remove (small_name), "remove \"%s\"", small_name);
+
+  CHECK (try_preallocate (cap - STEP), "preallocate most of the disk again");
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(prealloc-space) begin
+(prealloc-space) create "big"
+(prealloc-space) open "big"
+(prealloc-space) close "big"
+(prealloc-space) remove "big"
+(prealloc-space) preallocated most of the disk
+(prealloc-space) preallocate most of the disk again (0)
+(prealloc-space) preallocate most of the disk again (1)
+(prealloc-space) preallocate most of the disk again (2)
+(prealloc-space) create "small"
+(prealloc-space) open "small"
+(prealloc-space) write "small"
+(prealloc-space) preallocate fails while "small" holds space
+(prealloc-space) close "small"
+(prealloc-space) remove "small"
+(prealloc-space) preallocate most of the disk again
+(prealloc-space) end
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Preallocates space around and past the data in a file, and checks
+   that the file grows, that the new space reads back as zeros, and
+   that the data already there is left alone. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_SIZE 700
+#define FILE_SIZE 9000
+
+static const char file_name[] = "prealloc";
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_bytes (buf, DATA_SIZE);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, DATA_SIZE) == DATA_SIZE, "write \"%s\"", file_name);
+  CHECK (preallocate (fd, 3000, FILE_SIZE - 3000),
+         "preallocate past end of \"%s\"", file_name);
+  CHECK (preallocate (fd, 0, DATA_SIZE),
+         "preallocate over data of \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, FILE_SIZE);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(prealloc-zeros) begin
+(prealloc-zeros) create "prealloc"
+(prealloc-zeros) open "prealloc"
+(prealloc-zeros) write "prealloc"
+(prealloc-zeros) preallocate past end of "prealloc"
+(prealloc-zeros) preallocate over data of "prealloc"
+(prealloc-zeros) close "prealloc"
+(prealloc-zeros) open "prealloc" for verification
+(prealloc-zeros) verified contents of "prealloc"
+(prealloc-zeros) close "prealloc"
+(prealloc-zeros) end
+EOF
+pass;
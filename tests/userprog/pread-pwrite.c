@@ -0,0 +1,41 @@
+/* Reads and writes "sample.txt" at explicit offsets with pread() and
+   pwrite(), which must leave the file position alone, and reads past
+   the end of the file, which must come up short. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[sizeof sample];
+  size_t size = sizeof sample - 1;
+  char buf[64];
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  CHECK (pread (handle, buf, 10, 20) == 10, "pread 10 bytes at offset 20");
+  compare_bytes (buf, sample + 20, 10, 20, "sample.txt");
+  CHECK (tell (handle) == 0, "pread leaves position at 0");
+
+  CHECK (pread (handle, buf, sizeof buf, size - 5) == 5,
+         "pread across end of file returns 5 bytes");
+  compare_bytes (buf, sample + size - 5, 5, size - 5, "sample.txt");
+  CHECK (pread (handle, buf, sizeof buf, size) == 0,
+         "pread at end of file returns 0");
+
+  CHECK (pwrite (handle, "XYZ", 3, 7) == 3, "pwrite 3 bytes at offset 7");
+  CHECK (tell (handle) == 0, "pwrite leaves position at 0");
+  CHECK (pread (handle, buf, 5, 6) == 5, "pread 5 bytes at offset 6");
+  memcpy (expected, sample, sizeof sample);
+  memcpy (expected + 7, "XYZ", 3);
+  compare_bytes (buf, expected + 6, 5, 6, "sample.txt");
+
+  msg ("close \"sample.txt\"");
+  close (handle);
+  check_file ("sample.txt", expected, size);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) open "sample.txt"
+(pread-pwrite) pread 10 bytes at offset 20
+(pread-pwrite) pread leaves position at 0
+(pread-pwrite) pread across end of file returns 5 bytes
+(pread-pwrite) pread at end of file returns 0
+(pread-pwrite) pwrite 3 bytes at offset 7
+(pread-pwrite) pwrite leaves position at 0
+(pread-pwrite) pread 5 bytes at offset 6
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) open "sample.txt" for verification
+(pread-pwrite) verified contents of "sample.txt"
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
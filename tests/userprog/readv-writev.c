@@ -0,0 +1,47 @@
+/* Writes a file from several buffers with writev() and reads it back
+   into several buffers with readv(), checking that both move the file
+   position and that a read running past the end of the file comes up
+   short. */
+
+#include <string.h>
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char data[] = "abcdefgh";
+  struct iovec iov[3];
+  char a[3], b[10];
+  int handle;
+
+  CHECK (create ("vec.txt", 0), "create \"vec.txt\"");
+  CHECK ((handle = open ("vec.txt")) > 1, "open \"vec.txt\"");
+
+  iov[0].iov_base = (void *) "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = NULL;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = (void *) "defgh";
+  iov[2].iov_len = 5;
+  CHECK (writev (handle, iov, 3) == 8, "writev 8 bytes from 3 buffers");
+  CHECK (tell (handle) == 8, "writev moves position to 8");
+
+  seek (handle, 2);
+  iov[0].iov_base = a;
+  iov[0].iov_len = sizeof a;
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof b;
+  CHECK (readv (handle, iov, 2) == 6,
+         "readv across end of file returns 6 bytes");
+  compare_bytes (a, data + 2, 3, 2, "vec.txt");
+  compare_bytes (b, data + 5, 3, 5, "vec.txt");
+  CHECK (tell (handle) == 8, "readv moves position to 8");
+  CHECK (readv (handle, iov, 2) == 0, "readv at end of file returns 0");
+
+  msg ("close \"vec.txt\"");
+  close (handle);
+  check_file ("vec.txt", data, 8);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "vec.txt"
+(readv-writev) open "vec.txt"
+(readv-writev) writev 8 bytes from 3 buffers
+(readv-writev) writev moves position to 8
+(readv-writev) readv across end of file returns 6 bytes
+(readv-writev) readv moves position to 8
+(readv-writev) readv at end of file returns 0
+(readv-writev) close "vec.txt"
+(readv-writev) open "vec.txt" for verification
+(readv-writev) verified contents of "vec.txt"
+(readv-writev) close "vec.txt"
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Touches a few pages, then drains the VM event trace and dumps it.
+   Each first touch must show up as a write fault on an anonymous
+   page. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <vmtrace.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 3
+#define REC_CNT 256
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+static struct vmtrace_rec recs[REC_CNT];
+
+static const char *kinds[] = { "fault", "evict", "swap-in", "swap-out" };
+
+void
+test_main (void)
+{
+	size_t cnt, i, j;
+
+	/* Throw away what loading the test left behind. */
+	while (vmtrace (recs, REC_CNT) > 0)
+		continue;
+
+	for (i = 0; i < PAGE_CNT; i++)
+		buf[i * PAGE_SIZE] = i;
+
+	cnt = vmtrace (recs, REC_CNT);
+	for (j = 0; j < cnt; j++) {
+		struct vmtrace_rec *r = &recs[j];
+		msg ("rec %s va=%#llx tid=%d type=%d flags=%#x time=%lld cost=%d",
+				r->kind < 4 ? kinds[r->kind] : "?",
+				(unsigned long long) r->va, r->tid, r->type, r->flags,
+				(long long) r->time, r->cost);
+	}
+
+	for (i = 0; i < PAGE_CNT; i++) {
+		uint64_t va = (uintptr_t) &buf[i * PAGE_SIZE];
+		bool found = false;
+
+		for (j = 0; j < cnt; j++)
+			if (recs[j].kind == VMTRACE_FAULT && recs[j].va == va
+					&& (recs[j].flags & VMTRACE_WRITE)
+					&& !(recs[j].flags & VMTRACE_FAILED)
+					&& recs[j].type == VMTRACE_TYPE_ANON)
+				found = true;
+		CHECK (found, "write fault on page %zu", i);
+	}
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The dumped records vary from run to run.
+@output = grep (!/^\(vm-trace\) rec /, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(vm-trace) begin
+(vm-trace) write fault on page 0
+(vm-trace) write fault on page 1
+(vm-trace) write fault on page 2
+(vm-trace) end
+EOF
+pass;
@@ -31,11 +31,15 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer-cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -236,6 +240,20 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-wmark-low"))
+			vm_wmark_low = atoi (value);
+		else if (!strcmp (name, "-wmark-high"))
+			vm_wmark_high = atoi (value);
+		else if (!strcmp (name, "-swap-ra"))
+			anon_readahead_pages = atoi (value);
+		else if (!strcmp (name, "-zswap"))
+			zswap_budget = atoi (value);
+		else if (!strcmp (name, "-stack-limit"))
+			vm_stack_limit = atoi (value);
+		else if (!strcmp (name, "-stack-gap"))
+			vm_stack_gap = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -347,6 +365,14 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -wmark-low=COUNT   Wake kswapd below COUNT free user pages.\n"
+			"  -wmark-high=COUNT  Let kswapd evict until COUNT pages are free.\n"
+			"  -swap-ra=COUNT     Read up to COUNT nearby swap slots on swap-in.\n"
+			"  -zswap=COUNT       Compress swapped pages into up to COUNT pages.\n"
+			"  -stack-limit=COUNT Let user stacks grow to COUNT pages.\n"
+			"  -stack-gap=COUNT   Keep COUNT unmapped pages below user stacks.\n"
 #endif
 			);
 	power_off ();
@@ -375,10 +401,16 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	dcache_print_stats ();
+	journal_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	zswap_print_stats ();
+#endif
 }
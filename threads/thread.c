@@ -759,6 +759,15 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->init_priority = priority;
 	t->wait_on_lock = NULL;
 	list_init(&t->donations);
+
+#ifdef USERPROG
+	sema_init (&t->fork_done, 0);
+	t->attached = false;
+	t->exit_status = -1;
+	list_init (&t->children);
+	sema_init (&t->exited, 0);
+	sema_init (&t->reaped, 0);
+#endif
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -13,6 +13,7 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
@@ -24,7 +25,7 @@
 
 static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
-static void initd (void *f_name);
+static void initd (void *args);
 static void __do_fork (void *);
 void argument_stack(char **argv, int argc, struct intr_frame *if_);
 
@@ -32,8 +33,28 @@ void argument_stack(char **argv, int argc, struct intr_frame *if_);
 static void
 process_init (void) {
 	struct thread *current = thread_current ();
+
+	/* Without a descriptor table, opening a file just fails. */
+	current->fds = calloc (FD_MAX, sizeof *current->fds);
+}
+
+/* Puts the running process on PARENT's list of children, so that PARENT
+ * can wait for it and it stays around after exiting until PARENT has.
+ * PARENT must be blocked on its FORK_DONE meanwhile. */
+static void
+process_attach (struct thread *parent) {
+	struct thread *curr = thread_current ();
+
+	list_push_back (&parent->children, &curr->child_elem);
+	curr->attached = true;
 }
 
+/* Start-up arguments of initd, on process_create_initd()'s stack. */
+struct initd_args {
+	char *file_name;                    /* Command line, in a page. */
+	struct thread *parent;              /* Thread starting initd. */
+};
+
 /* Starts the first userland program, called "initd", loaded from FILE_NAME.
  * The new thread may be scheduled (and may even exit)
  * before process_create_initd() returns. Returns the initd's
@@ -43,6 +64,7 @@ process_init (void) {
    palloc으로 커널 가용 페이지 할당하고  */
 tid_t
 process_create_initd (const char *file_name) { // "filename "echo x" a b c d"
+	struct initd_args args;
 	char *fn_copy;
 	tid_t tid;
 
@@ -58,12 +80,17 @@ process_create_initd (const char *file_name) { // "filename "echo x" a b c d"
 	strtok_r(file_name, " ", &save_ptr);  // file_name : "args-single", save_ptr : "onearg"
 
 	/* Create a new thread to execute FILE_NAME. */
-	tid = thread_create (file_name, PRI_DEFAULT, initd, fn_copy);
+	args.file_name = fn_copy;
+	args.parent = thread_current ();
+	tid = thread_create (file_name, PRI_DEFAULT, initd, &args);
 	// 이름은 file_name(parsing됨), 
   	// 우선순위 값은 PRI_DEFAULT인 스레드를 생성하고 그 tid를 반환
 	// 해당 스레드가 실행되면 fn_copy를 인자로 받는 initd() 함수를 실행해서 받아온 인자들을 넣어줌
 	if (tid == TID_ERROR)
 		palloc_free_page (fn_copy);
+	else
+		/* ARGS must stay valid until initd has attached. */
+		sema_down (&args.parent->fork_done);
 	return tid;
 }
 
@@ -72,12 +99,18 @@ process_create_initd (const char *file_name) { // "filename "echo x" a b c d"
 /* 해당 프로세스를 초기화하고 process_exec() 함수를 실행 */
 /* 처음으로 유저 프로세스를 만듦 */
 static void
-initd (void *f_name) {
+initd (void *args_) {
+	struct initd_args *args = args_;
+	struct thread *parent = args->parent;
+	char *f_name = args->file_name;
+
 #ifdef VM
 	supplemental_page_table_init (&thread_current ()->spt);
 #endif
 
 	process_init ();
+	process_attach (parent);
+	sema_up (&parent->fork_done);
 
 	if (process_exec (f_name) < 0) {	// process_exec 함수 실행
 		PANIC("Fail to launch initd\n");
@@ -88,10 +121,18 @@ initd (void *f_name) {
 /* Clones the current process as `name`. Returns the new process's thread id, or
  * TID_ERROR if the thread cannot be created. */
 tid_t
-process_fork (const char *name, struct intr_frame *if_ UNUSED) {
-	/* Clone current thread to new thread.*/
-	return thread_create (name,
-			PRI_DEFAULT, __do_fork, thread_current ());
+process_fork (const char *name, struct intr_frame *if_) {
+	struct thread *curr = thread_current ();
+	tid_t tid;
+
+	/* Clone current thread to new thread.  The child copies IF_ and the
+	 * rest of the process from under us, so wait until it is done. */
+	curr->fork_if = if_;
+	tid = thread_create (name, PRI_DEFAULT, __do_fork, curr);
+	if (tid == TID_ERROR)
+		return TID_ERROR;
+	sema_down (&curr->fork_done);
+	return curr->fork_success ? tid : TID_ERROR;
 }
 
 #ifndef VM
@@ -105,22 +146,29 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	void *newpage;
 	bool writable;
 
-	/* 1. TODO: If the parent_page is kernel page, then return immediately. */
+	/* 1. If the parent_page is kernel page, then return immediately. */
+	if (is_kernel_vaddr (va))
+		return true;
 
 	/* 2. Resolve VA from the parent's page map level 4. */
 	parent_page = pml4_get_page (parent->pml4, va);
 
-	/* 3. TODO: Allocate new PAL_USER page for the child and set result to
-	 *    TODO: NEWPAGE. */
+	/* 3. Allocate new PAL_USER page for the child and set result to
+	 *    NEWPAGE. */
+	newpage = palloc_get_page (PAL_USER);
+	if (newpage == NULL)
+		return false;
 
-	/* 4. TODO: Duplicate parent's page to the new page and
-	 *    TODO: check whether parent's page is writable or not (set WRITABLE
-	 *    TODO: according to the result). */
+	/* 4. Duplicate parent's page to the new page and check whether
+	 *    parent's page is writable or not. */
+	memcpy (newpage, parent_page, PGSIZE);
+	writable = is_writable (pte);
 
 	/* 5. Add new page to child's page table at address VA with WRITABLE
 	 *    permission. */
 	if (!pml4_set_page (current->pml4, va, newpage, writable)) {
-		/* 6. TODO: if fail to insert page, do error handling. */
+		palloc_free_page (newpage);
+		return false;
 	}
 	return true;
 }
@@ -135,12 +183,12 @@ __do_fork (void *aux) {
 	struct intr_frame if_;
 	struct thread *parent = (struct thread *) aux;
 	struct thread *current = thread_current ();
-	/* TODO: somehow pass the parent_if. (i.e. process_fork()'s if_) */
-	struct intr_frame *parent_if;
-	bool succ = true;
+	struct intr_frame *parent_if = parent->fork_if;
 
-	/* 1. Read the cpu context to local stack. */
+	/* 1. Read the cpu context to local stack.  fork() returns 0 in the
+	 *    child. */
 	memcpy (&if_, parent_if, sizeof (struct intr_frame));
+	if_.R.rax = 0;
 
 	/* 2. Duplicate PT */
 	current->pml4 = pml4_create();
@@ -152,23 +200,36 @@ __do_fork (void *aux) {
 	supplemental_page_table_init (&current->spt);
 	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
 		goto error;
+	current->stack_bottom = parent->stack_bottom;
 #else
 	if (!pml4_for_each (parent->pml4, duplicate_pte, parent))
 		goto error;
 #endif
 
-	/* TODO: Your code goes here.
-	 * TODO: Hint) To duplicate the file object, use `file_duplicate`
-	 * TODO:       in include/filesys/file.h. Note that parent should not return
-	 * TODO:       from the fork() until this function successfully duplicates
-	 * TODO:       the resources of parent.*/
-
+	/* Duplicate the open files.  The parent does not return from fork()
+	 * until this is done. */
 	process_init ();
+	if (parent->fds != NULL) {
+		int fd;
+
+		if (current->fds == NULL)
+			goto error;
+		for (fd = 0; fd < FD_MAX; fd++)
+			if (parent->fds[fd] != NULL) {
+				current->fds[fd] = file_duplicate (parent->fds[fd]);
+				if (current->fds[fd] == NULL)
+					goto error;
+			}
+	}
 
 	/* Finally, switch to the newly created process. */
-	if (succ)
-		do_iret (&if_);
+	process_attach (parent);
+	parent->fork_success = true;
+	sema_up (&parent->fork_done);
+	do_iret (&if_);
 error:
+	parent->fork_success = false;
+	sema_up (&parent->fork_done);
 	thread_exit ();
 }
 
@@ -210,8 +271,6 @@ process_exec (void *f_name) { // 유저가 입력한 명령어를 수행하도
 		return -1;
 	}
 
-	hex_dump(_if.rsp, _if.rsp, USER_STACK - _if.rsp, true); // 유저 스택에 담기는 값을 확인하려고 메모리 안에 있는 걸 16진수로 값을 보여줌
-
 	/* If load failed, quit. */
 	palloc_free_page (file_name); // file_name: 프로그램 파일 받기 위해 만든 임시변수. 
 								  // palloc()은 load() 함수 내에서 file_name을 메모리에 올리는 과정에서 page allocation을 해줌
@@ -280,20 +339,27 @@ void argument_stack(char **argv, int argc, struct intr_frame *if_) { // if_는 
  * exception), returns -1.  If TID is invalid or if it was not a
  * child of the calling process, or if process_wait() has already
  * been successfully called for the given TID, returns -1
- * immediately, without waiting.
- *
- * This function will be implemented in problem 2-2.  For now, it
- * does nothing. */
-/* 부모 스레드는 자식 프로세스가 실행되는 것을 기다렸다가
-   자식 프로세스가 종료되면 시그널을 받아 부모 스레드가 종료되어야 함
-   그러나 바로 종료되어 버리므로 자식 프로세스가 실행되지 못함
-   process_wait()에 무한 루프를 넣어 자식 프로세스가 실행될 수 있게 해 줌 */
+ * immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) {
-	/* XXX: Hint) The pintos exit if process_wait (initd), we recommend you
-	 * XXX:       to add infinite loop here before
-	 * XXX:       implementing the process_wait. */
-	while(1) {}; // 자식 프로세스가 실행될 수 있도록 무한루프 추가
+process_wait (tid_t child_tid) {
+	struct thread *curr = thread_current ();
+	struct list_elem *e;
+
+	for (e = list_begin (&curr->children); e != list_end (&curr->children);
+			e = list_next (e)) {
+		struct thread *child = list_entry (e, struct thread, child_elem);
+		int status;
+
+		if (child->tid != child_tid)
+			continue;
+
+		/* The child stays around until it is reaped. */
+		sema_down (&child->exited);
+		status = child->exit_status;
+		list_remove (&child->child_elem);
+		sema_up (&child->reaped);
+		return status;
+	}
 	return -1;
 }
 
@@ -301,12 +367,28 @@ process_wait (tid_t child_tid UNUSED) {
 void
 process_exit (void) {
 	struct thread *curr = thread_current ();
-	/* TODO: Your code goes here.
-	 * TODO: Implement process termination message (see
-	 * TODO: project2/process_termination.html).
-	 * TODO: We recommend you to implement process resource cleanup here. */
 
+	/* Children that were never waited for need not wait for us. */
+	while (!list_empty (&curr->children))
+		sema_up (&list_entry (list_pop_front (&curr->children), struct thread,
+					child_elem)->reaped);
+
+	if (curr->pml4 != NULL)
+		printf ("%s: exit(%d)\n", curr->name, curr->exit_status);
+
+	if (curr->fds != NULL) {
+		int fd;
+
+		for (fd = 0; fd < FD_MAX; fd++)
+			file_close (curr->fds[fd]);
+		free (curr->fds);
+		curr->fds = NULL;
+	}
 	process_cleanup ();
+
+	sema_up (&curr->exited);
+	if (curr->attached)
+		sema_down (&curr->reaped);
 }
 
 /* Free the current process's resources. */
@@ -316,6 +398,8 @@ process_cleanup (void) {
 
 #ifdef VM
 	supplemental_page_table_kill (&curr->spt);
+	file_close (curr->running_file);
+	curr->running_file = NULL;
 #endif
 
 	uint64_t *pml4;
@@ -581,7 +665,13 @@ load (const char *file_name, struct intr_frame *if_) { // file_name으로 함수
 
 done:
 	/* We arrive here whether the load is successful or not. */
+#ifdef VM
+	/* Segment pages are read from FILE on demand, so it stays open
+	 * until the process exits. */
+	t->running_file = file;
+#else
 	file_close (file);
+#endif
 	return success;
 }
 
@@ -734,11 +824,26 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Where lazy_load_segment() finds the contents of a segment page. */
+struct segment_aux {
+	struct file *file;          /* Executable, owned by the thread. */
+	off_t ofs;                  /* Offset of the page's data in FILE. */
+	size_t read_bytes;          /* Bytes to read; the rest is zeroed. */
+};
+
+/* Loads the segment page PAGE from the executable on its first fault. */
 static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+lazy_load_segment (struct page *page, void *aux_) {
+	struct segment_aux *aux = aux_;
+	uint8_t *kva = page->frame->kva;
+	bool success;
+
+	success = file_read_at (aux->file, kva, aux->read_bytes, aux->ofs)
+		== (off_t) aux->read_bytes;
+	if (success)
+		memset (kva + aux->read_bytes, 0, PGSIZE - aux->read_bytes);
+	free (aux);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -769,16 +874,23 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
+		struct segment_aux *aux = malloc (sizeof *aux);
+		if (aux == NULL)
+			return false;
+		aux->file = file;
+		aux->ofs = ofs;
+		aux->read_bytes = page_read_bytes;
 		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
+					writable, lazy_load_segment, aux)) {
+			free (aux);
 			return false;
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -789,10 +901,12 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
+	if (vm_alloc_page (VM_ANON | VM_STACK, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		thread_current ()->stack_bottom = stack_bottom;
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 
 	return success;
 }
@@ -1,12 +1,27 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
+#include "devices/input.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
 #include "userprog/gdt.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
+#include "threads/vaddr.h"
+#include "threads/mmu.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/vm.h"
+#include "vm/trace.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
@@ -37,13 +52,420 @@ syscall_init (void) {
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
 }
 
+/* Terminates the current process with exit status STATUS. */
+static void NO_RETURN
+sys_exit (int status) {
+	thread_current ()->exit_status = status;
+	thread_exit ();
+}
+
+/* Returns true if the process may access the user page containing UADDR,
+ * for writing if WRITE is true.  With VM, an address just below the stack
+ * is accepted by growing the stack over it, as a fault there would. */
+static bool
+user_page_ok (const void *uaddr, bool write) {
+	struct thread *curr = thread_current ();
+#ifdef VM
+	struct page *page = spt_find_page (&curr->spt, (void *) uaddr);
+	if (page == NULL)
+		return vm_grow_stack ((void *) uaddr);
+	return !write || page->writable;
+#else
+	const void *upage = pg_round_down (uaddr);
+	uint64_t *pte = pml4e_walk (curr->pml4, (uint64_t) upage, 0);
+	return pte != NULL && (*pte & PTE_P) && (!write || is_writable (pte));
+#endif
+}
+
+/* Terminates the process unless the SIZE bytes at UADDR are user memory
+ * that it may access, for writing if WRITE is true. */
+static void
+check_user_buffer (const void *uaddr, size_t size, bool write) {
+	const void *upage;
+
+	if (size == 0)
+		return;
+	if (uaddr == NULL || !is_user_vaddr (uaddr)
+			|| !is_user_vaddr (uaddr + size - 1) || uaddr + size < uaddr)
+		sys_exit (-1);
+
+	for (upage = pg_round_down (uaddr); upage < uaddr + size;
+			upage += PGSIZE)
+		if (!user_page_ok (upage < uaddr ? uaddr : upage, write))
+			sys_exit (-1);
+}
+
+/* Terminates the process unless USTR is a null-terminated string in user
+ * memory that it may read. */
+static void
+check_user_string (const char *ustr) {
+	const char *p = ustr;
+
+	if (ustr == NULL)
+		sys_exit (-1);
+	do {
+		if (p == ustr || pg_ofs (p) == 0)
+			check_user_buffer (p, 1, false);
+	} while (*p++ != '\0');
+}
+
+/* Copies user string USTR into a new page, which the caller must free.
+ * Terminates the process if USTR is not valid; returns a null pointer if
+ * it does not fit or memory runs out. */
+static char *
+copy_in_string (const char *ustr) {
+	char *kstr;
+
+	check_user_string (ustr);
+	kstr = palloc_get_page (0);
+	if (kstr != NULL && strlcpy (kstr, ustr, PGSIZE) >= PGSIZE) {
+		palloc_free_page (kstr);
+		kstr = NULL;
+	}
+	return kstr;
+}
+
+/* Runs the program and arguments in CMD_LINE in place of the current
+ * process.  Returns only on failure, by terminating the process. */
+static void NO_RETURN
+sys_exec (const char *cmd_line) {
+	char *kcmd = copy_in_string (cmd_line);
+
+	if (kcmd != NULL && process_exec (kcmd) < 0)
+		palloc_free_page (kcmd);
+	sys_exit (-1);
+}
+
+/* Returns the file open as descriptor FD in the running process, or a
+ * null pointer if there is none. */
+static struct file *
+fd_file (int fd) {
+	struct file **fds = thread_current ()->fds;
+
+	if (fds == NULL || fd < 2 || fd >= FD_MAX)
+		return NULL;
+	return fds[fd];
+}
+
+/* Opens FILE and returns its descriptor, or -1 on failure. */
+static int
+sys_open (const char *file) {
+	struct file **fds = thread_current ()->fds;
+	int fd;
+
+	check_user_string (file);
+	if (fds == NULL)
+		return -1;
+	for (fd = 2; fd < FD_MAX; fd++)
+		if (fds[fd] == NULL) {
+			fds[fd] = filesys_open (file);
+			return fds[fd] != NULL ? fd : -1;
+		}
+	return -1;
+}
+
+/* Closes descriptor FD. */
+static void
+sys_close (int fd) {
+	if (fd_file (fd) != NULL) {
+		file_close (thread_current ()->fds[fd]);
+		thread_current ()->fds[fd] = NULL;
+	}
+}
+
+/* Allocates disk space for LENGTH bytes at OFFSET of descriptor FD's
+ * file. */
+static bool
+sys_preallocate (int fd, off_t offset, off_t length) {
+	struct file *file = fd_file (fd);
+
+	if (file == NULL || offset < 0 || length < 0
+			|| offset > INT32_MAX - length)
+		return false;
+	return file_preallocate (file, offset, length);
+}
+
+/* Copies up to SIZE bytes between BUF and the CNT user buffers in IOV,
+ * starting at byte *OFS of buffer *IDX and advancing both past the
+ * bytes copied.  Copies into the user buffers if TO_USER is true. */
+static void
+iov_copy (const struct iovec *iov, int cnt, int *idx, size_t *ofs,
+		void *buf, size_t size, bool to_user) {
+	uint8_t *p = buf;
+
+	while (size > 0 && *idx < cnt) {
+		uint8_t *ubuf = (uint8_t *) iov[*idx].iov_base + *ofs;
+		size_t chunk = iov[*idx].iov_len - *ofs;
+
+		if (chunk > size)
+			chunk = size;
+		if (to_user)
+			memcpy (ubuf, p, chunk);
+		else
+			memcpy (p, ubuf, chunk);
+		p += chunk;
+		size -= chunk;
+		*ofs += chunk;
+		if (*ofs == iov[*idx].iov_len) {
+			(*idx)++;
+			*ofs = 0;
+		}
+	}
+}
+
+/* Reads from descriptor FD into the CNT user buffers in IOV, or writes
+ * to it from them if WRITE is true.  A file is accessed at OFFSET, or at
+ * its position if OFFSET is negative, which then advances.  Returns the
+ * number of bytes transferred, or -1 if FD cannot be used.
+ *
+ * The buffers are gathered into, or scattered from, one page-sized
+ * bounce buffer, so that the file system sees a few large contiguous
+ * requests however the data is split up in user memory, and never
+ * touches user memory itself: a page fault there while it holds a cache
+ * entry could need that same entry to page the data in. */
+static int
+transfer (int fd, const struct iovec *iov, int cnt, off_t offset,
+		bool write) {
+	struct file *file = fd_file (fd);
+	bool console = (write ? fd == 1 : fd == 0) && offset < 0;
+	bool at_position = offset < 0;
+	size_t total = 0, done = 0, ofs = 0;
+	int i, idx = 0;
+	uint8_t *bounce;
+
+	if (file == NULL && !console)
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (iov[i].iov_len > INT32_MAX - total)
+			return -1;
+		check_user_buffer (iov[i].iov_base, iov[i].iov_len, !write);
+		total += iov[i].iov_len;
+	}
+	if (total == 0)
+		return 0;
+	bounce = palloc_get_page (0);
+	if (bounce == NULL)
+		return -1;
+	if (file != NULL && at_position)
+		offset = file_tell (file);
+
+	while (done < total) {
+		size_t chunk = total - done < PGSIZE ? total - done : PGSIZE;
+		size_t n;
+
+		if (write) {
+			iov_copy (iov, cnt, &idx, &ofs, bounce, chunk, false);
+			if (console) {
+				putbuf ((const char *) bounce, chunk);
+				n = chunk;
+			} else
+				n = file_write_at (file, bounce, chunk, offset + done);
+		} else {
+			if (console) {
+				for (n = 0; n < chunk; n++)
+					bounce[n] = input_getc ();
+			} else
+				n = file_read_at (file, bounce, chunk, offset + done);
+			iov_copy (iov, cnt, &idx, &ofs, bounce, n, true);
+		}
+		done += n;
+		if (n < chunk)
+			break;
+	}
+
+	if (file != NULL && at_position)
+		file_seek (file, offset + done);
+	palloc_free_page (bounce);
+	return done;
+}
+
+/* Reads or writes SIZE bytes at BUFFER from or to descriptor FD at its
+ * position. */
+static int
+sys_rw (int fd, void *buffer, unsigned size, bool write) {
+	struct iovec iov = { buffer, size };
+
+	return transfer (fd, &iov, 1, -1, write);
+}
+
+/* Reads or writes SIZE bytes at BUFFER from or to descriptor FD at
+ * OFFSET. */
+static int
+sys_pio (int fd, void *buffer, unsigned size, off_t offset, bool write) {
+	struct iovec iov = { buffer, size };
+
+	if (offset < 0 || fd_file (fd) == NULL)
+		return -1;
+	return transfer (fd, &iov, 1, offset, write);
+}
+
+/* Reads or writes descriptor FD at its position, from or to the IOVCNT
+ * user buffers described by UIOV. */
+static int
+sys_vio (int fd, const struct iovec *uiov, int iovcnt, bool write) {
+	struct iovec *iov;
+	int result;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX)
+		return -1;
+	if (iovcnt == 0)
+		return 0;
+	check_user_buffer (uiov, iovcnt * sizeof *uiov, false);
+	iov = malloc (iovcnt * sizeof *iov);
+	if (iov == NULL)
+		return -1;
+	memcpy (iov, uiov, iovcnt * sizeof *iov);
+	result = transfer (fd, iov, iovcnt, -1, write);
+	free (iov);
+	return result;
+}
+
+/* Copies LENGTH bytes from descriptor FD_IN to descriptor FD_OUT within
+ * the kernel.  Each file is accessed at the offset that UOFF_IN or
+ * UOFF_OUT points to, which then advances, or at its position if the
+ * pointer is null.  Returns the number of bytes copied, or -1 if a
+ * descriptor is not an open file or the ranges overlap in one file. */
+static int
+sys_copy_file_range (int fd_in, off_t *uoff_in, int fd_out,
+		off_t *uoff_out, unsigned length) {
+	struct file *in = fd_file (fd_in), *out = fd_file (fd_out);
+	off_t in_ofs, out_ofs;
+	int result;
+
+	if (in == NULL || out == NULL || length > INT32_MAX)
+		return -1;
+	if (uoff_in != NULL) {
+		check_user_buffer (uoff_in, sizeof *uoff_in, true);
+		in_ofs = *uoff_in;
+	} else
+		in_ofs = file_tell (in);
+	if (uoff_out != NULL) {
+		check_user_buffer (uoff_out, sizeof *uoff_out, true);
+		out_ofs = *uoff_out;
+	} else
+		out_ofs = file_tell (out);
+	if (in_ofs < 0 || out_ofs < 0 || in_ofs > INT32_MAX - (off_t) length
+			|| out_ofs > INT32_MAX - (off_t) length)
+		return -1;
+	if (file_get_inode (in) == file_get_inode (out)
+			&& in_ofs < out_ofs + (off_t) length
+			&& out_ofs < in_ofs + (off_t) length)
+		return -1;
+
+	result = file_copy_range (in, in_ofs, out, out_ofs, length);
+	if (uoff_in != NULL)
+		*uoff_in = in_ofs + result;
+	else
+		file_seek (in, in_ofs + result);
+	if (uoff_out != NULL)
+		*uoff_out = out_ofs + result;
+	else
+		file_seek (out, out_ofs + result);
+	return result;
+}
+
+/* Writes the changes made to descriptor FD's file to disk, or if
+ * DATA_ONLY just its data and the metadata needed to read that back.
+ * Returns 0 if successful, -1 otherwise. */
+static int
+sys_fsync (int fd, bool data_only) {
+	struct file *file = fd_file (fd);
+
+	if (file == NULL)
+		return -1;
+	return (data_only ? file_datasync (file) : file_sync (file)) ? 0 : -1;
+}
+
 /* The main system call interface */
 void
-syscall_handler (struct intr_frame *f UNUSED) {
-	// TODO: Your implementation goes here.
-	printf ("system call!\n");
+syscall_handler (struct intr_frame *f) {
+#ifdef VM
+	/* Page faults taken on user memory inside the kernel need this to
+	 * tell stack accesses apart. */
+	thread_current ()->user_rsp = (void *) f->rsp;
+#endif
 
-	thread_exit ();
+	switch (f->R.rax) {
+		case SYS_HALT:
+			power_off ();
+		case SYS_EXIT:
+			sys_exit (f->R.rdi);
+		case SYS_FORK:
+			check_user_string ((const char *) f->R.rdi);
+			f->R.rax = process_fork ((const char *) f->R.rdi, f);
+			break;
+		case SYS_EXEC:
+			sys_exec ((const char *) f->R.rdi);
+		case SYS_WAIT:
+			f->R.rax = process_wait (f->R.rdi);
+			break;
+		case SYS_CREATE:
+			check_user_string ((const char *) f->R.rdi);
+			f->R.rax = filesys_create ((const char *) f->R.rdi, f->R.rsi);
+			break;
+		case SYS_REMOVE:
+			check_user_string ((const char *) f->R.rdi);
+			f->R.rax = filesys_remove ((const char *) f->R.rdi);
+			break;
+		case SYS_OPEN:
+			f->R.rax = sys_open ((const char *) f->R.rdi);
+			break;
+		case SYS_FILESIZE:
+			f->R.rax = fd_file (f->R.rdi) != NULL
+				? file_length (fd_file (f->R.rdi)) : -1;
+			break;
+		case SYS_READ:
+		case SYS_WRITE:
+			f->R.rax = sys_rw (f->R.rdi, (void *) f->R.rsi, f->R.rdx,
+					f->R.rax == SYS_WRITE);
+			break;
+		case SYS_SEEK:
+			if (fd_file (f->R.rdi) != NULL)
+				file_seek (fd_file (f->R.rdi), f->R.rsi);
+			break;
+		case SYS_TELL:
+			f->R.rax = fd_file (f->R.rdi) != NULL
+				? file_tell (fd_file (f->R.rdi)) : -1;
+			break;
+		case SYS_CLOSE:
+			sys_close (f->R.rdi);
+			break;
+#ifdef VM
+		case SYS_VMTRACE:
+			if (f->R.rsi > USER_STACK / sizeof (struct vmtrace_rec))
+				sys_exit (-1);
+			check_user_buffer ((void *) f->R.rdi,
+					f->R.rsi * sizeof (struct vmtrace_rec), true);
+			f->R.rax = vm_trace_drain ((void *) f->R.rdi, f->R.rsi);
+			break;
+#endif
+		case SYS_PREALLOCATE:
+			f->R.rax = sys_preallocate (f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_PREAD:
+		case SYS_PWRITE:
+			f->R.rax = sys_pio (f->R.rdi, (void *) f->R.rsi, f->R.rdx, f->R.r10,
+					f->R.rax == SYS_PWRITE);
+			break;
+		case SYS_READV:
+		case SYS_WRITEV:
+			f->R.rax = sys_vio (f->R.rdi, (const struct iovec *) f->R.rsi,
+					f->R.rdx, f->R.rax == SYS_WRITEV);
+			break;
+		case SYS_COPY_FILE_RANGE:
+			f->R.rax = sys_copy_file_range (f->R.rdi, (off_t *) f->R.rsi,
+					f->R.rdx, (off_t *) f->R.r10, f->R.r8);
+			break;
+		case SYS_FSYNC:
+		case SYS_FDATASYNC:
+			f->R.rax = sys_fsync (f->R.rdi, f->R.rax == SYS_FDATASYNC);
+			break;
+		case SYS_SYNC:
+			filesys_sync ();
+			break;
+		default:
+			sys_exit (-1);
+	}
 }
 
 /* 주소값이 유저 영역에서 사용하는 주소 값인지 확인하는 함수
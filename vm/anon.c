@@ -1,7 +1,15 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include "vm/zswap.h"
+#include "vm/trace.h"
+#include "devices/timer.h"
 #include "devices/disk.h"
+#include <bitmap.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +25,249 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Number of disk sectors in a page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Swap slot of a page that is not in swap. */
+#define SWAP_SLOT_NONE BITMAP_ERROR
+
+/* Number of slots in a swap cluster.  Slots are handed out one after
+ * another from the current cluster, so pages that are evicted together
+ * end up next to each other on the swap disk. */
+#define SWAP_CLUSTER_SLOTS 16
+
+/* Most slots that one disk transfer, of at most 256 sectors, covers. */
+#define SWAP_RUN_MAX (256 / SECTORS_PER_SLOT)
+
+size_t anon_readahead_pages = 8;
+
+static struct bitmap *swap_table;   /* One bit per swap slot, true if used. */
+static struct page **slot_pages;    /* Page held in each used slot. */
+static size_t cluster_next;         /* Next slot of the current cluster. */
+static size_t cluster_end;          /* End of the current cluster. */
+static struct lock swap_lock;       /* Protects all of the above. */
+
+static size_t swap_slot_alloc (void);
+static void swap_slot_free (size_t slot);
+static void swap_read_run (struct page *page, size_t slot, void *kva);
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt;
+
+	swap_disk = disk_get (1, 1);
+	slot_cnt = swap_disk != NULL ? disk_size (swap_disk) / SECTORS_PER_SLOT : 0;
+	swap_table = bitmap_create (slot_cnt);
+	slot_pages = calloc (slot_cnt, sizeof *slot_pages);
+	if (swap_table == NULL || (slot_cnt > 0 && slot_pages == NULL))
+		PANIC ("swap table creation failed");
+	cluster_next = cluster_end = 0;
+	lock_init (&swap_lock);
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
+	memset (kva, 0, PGSIZE);
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot = SWAP_SLOT_NONE;
+	anon_page->zswap = NULL;
+	return true;
+}
+
+/* Reads swap slot SLOT into KVA. */
+static void
+swap_read (size_t slot, void *kva) {
+	disk_read_multi (swap_disk, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, kva);
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->swap_slot;
+	int64_t start = timer_ticks ();
+
+	if (zswap_load (anon_page->zswap, kva)) {
+		anon_page->zswap = NULL;
+		vm_trace (VMTRACE_SWAP_IN, page, page->va, VMTRACE_ZSWAP, start);
+		return true;
+	}
+	if (slot == SWAP_SLOT_NONE)
+		return false;
+
+	swap_read_run (page, slot, kva);
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by compressing it into zswap or, if that fails,
+ * writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	void *kva = page->frame->kva;
+	int64_t start = timer_ticks ();
+	size_t slot;
+
+	anon_page->zswap = zswap_store (kva);
+	if (anon_page->zswap != NULL) {
+		vm_trace (VMTRACE_SWAP_OUT, page, page->va, VMTRACE_ZSWAP, start);
+		return true;
+	}
+
+	lock_acquire (&swap_lock);
+	slot = swap_slot_alloc ();
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return false;
+
+	disk_write_multi (swap_disk, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, kva);
+	anon_page->swap_slot = slot;
+
+	lock_acquire (&swap_lock);
+	slot_pages[slot] = page;
+	lock_release (&swap_lock);
+	vm_trace (VMTRACE_SWAP_OUT, page, page->va, 0, start);
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->swap_slot != SWAP_SLOT_NONE)
+		swap_slot_free (anon_page->swap_slot);
+	zswap_free (anon_page->zswap);
+}
+
+/* Allocates a swap slot, preferably the next one of the current cluster.
+ * When the cluster is used up, starts a new one at the next run of
+ * SWAP_CLUSTER_SLOTS free slots, falling back to any free slot if swap is
+ * too fragmented for that.  Returns BITMAP_ERROR if swap is full.
+ * SWAP_LOCK must be held. */
+static size_t
+swap_slot_alloc (void) {
+	size_t slot;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+
+	if (cluster_next < cluster_end && !bitmap_test (swap_table, cluster_next))
+		slot = cluster_next;
+	else {
+		slot = bitmap_scan (swap_table, cluster_end, SWAP_CLUSTER_SLOTS, false);
+		if (slot == BITMAP_ERROR)
+			slot = bitmap_scan (swap_table, 0, SWAP_CLUSTER_SLOTS, false);
+		if (slot != BITMAP_ERROR)
+			cluster_end = slot + SWAP_CLUSTER_SLOTS;
+		else {
+			slot = bitmap_scan (swap_table, 0, 1, false);
+			if (slot == BITMAP_ERROR)
+				return BITMAP_ERROR;
+			cluster_end = slot + 1;
+		}
+	}
+
+	bitmap_mark (swap_table, slot);
+	cluster_next = slot + 1;
+	return slot;
+}
+
+/* Releases swap slot SLOT. */
+static void
+swap_slot_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	bitmap_reset (swap_table, slot);
+	slot_pages[slot] = NULL;
+	lock_release (&swap_lock);
+}
+
+/* Returns true if swap slot SLOT holds a page of PAGE's owner.
+ * SWAP_LOCK must be held. */
+static bool
+slot_owned (size_t slot, const struct page *page) {
+	struct page *p = slot_pages[slot];
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	return p != NULL && p->owner == page->owner;
+}
+
+/* Reads PAGE from swap slot SLOT into KVA, together with the pages of
+ * PAGE's process in the slots around it, while free frames last.  Pages
+ * evicted together share a cluster, so the run of the owner's slots
+ * around SLOT, up to anon_readahead_pages more of them, is collected
+ * first, forward and then backward, and read in one disk transfer.
+ *
+ * Ownership is checked under SWAP_LOCK, which a page's slot is freed
+ * under before the page itself goes away.  The owner is the thread
+ * running this fault, so once a page is known to be its own, nobody
+ * else can claim or destroy it under us. */
+static void
+swap_read_run (struct page *page, size_t slot, void *kva) {
+	struct frame *frames[SWAP_RUN_MAX];
+	struct page *pages[SWAP_RUN_MAX];
+	size_t limit = anon_readahead_pages, first, lo, hi, cnt, i;
+	int64_t start = timer_ticks ();
+	uint8_t *buffer = NULL;
+
+	if (limit > SWAP_RUN_MAX - 1)
+		limit = SWAP_RUN_MAX - 1;
+	lock_acquire (&swap_lock);
+	for (lo = hi = slot; hi - lo < limit; ) {
+		if (hi + 1 < bitmap_size (swap_table) && slot_owned (hi + 1, page))
+			hi++;
+		else if (lo > 0 && slot_owned (lo - 1, page))
+			lo--;
+		else
+			break;
+	}
+	for (i = lo; i <= hi; i++)
+		pages[i - lo] = slot_pages[i];
+	lock_release (&swap_lock);
+
+	/* Give the neighbours frames, and read only as far out as they got
+	 * one. */
+	first = lo;
+	cnt = hi - lo + 1;
+	if (cnt > 1)
+		buffer = palloc_get_multiple (0, cnt);
+	for (i = lo; i <= hi; i++)
+		frames[i - first] = buffer != NULL && i != slot
+			? vm_prefetch_frame (pages[i - first]) : NULL;
+	while (lo < slot && frames[lo - first] == NULL)
+		lo++;
+	while (hi > slot && frames[hi - first] == NULL)
+		hi--;
+
+	if (lo == hi)
+		swap_read (slot, kva);
+	else {
+		disk_read_multi (swap_disk, lo * SECTORS_PER_SLOT,
+				(hi - lo + 1) * SECTORS_PER_SLOT, buffer);
+		memcpy (kva, buffer + (slot - lo) * PGSIZE, PGSIZE);
+	}
+	page->anon.swap_slot = SWAP_SLOT_NONE;
+	swap_slot_free (slot);
+	vm_trace (VMTRACE_SWAP_IN, page, page->va, 0, start);
+
+	for (i = lo; i <= hi; i++) {
+		struct page *next = pages[i - first];
+		struct frame *frame = frames[i - first];
+
+		if (frame == NULL)
+			continue;
+		memcpy (frame->kva, buffer + (i - lo) * PGSIZE, PGSIZE);
+		next->anon.swap_slot = SWAP_SLOT_NONE;
+		swap_slot_free (i);
+		vm_trace (VMTRACE_SWAP_IN, next, next->va, VMTRACE_READAHEAD, start);
+		vm_map_frame (next);
+	}
+	if (buffer != NULL)
+		palloc_free_multiple (buffer, cnt);
 }
@@ -0,0 +1,81 @@
+/* trace.c: Ring buffer of page faults, evictions and swap I/O. */
+
+#include "vm/trace.h"
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Pages of records kept.  Once full, new records replace the oldest. */
+#define TRACE_PAGES 4
+#define TRACE_CNT (TRACE_PAGES * PGSIZE / sizeof (struct vmtrace_rec))
+
+static struct vmtrace_rec *ring;        /* TRACE_CNT records. */
+static size_t ring_head;                /* Total records ever added. */
+static size_t ring_tail;                /* Total records ever removed. */
+
+/* Initializes the trace buffer. */
+void
+vm_trace_init (void) {
+	ASSERT (VMTRACE_TYPE_UNINIT == VM_UNINIT && VMTRACE_TYPE_ANON == VM_ANON
+			&& VMTRACE_TYPE_FILE == VM_FILE
+			&& VMTRACE_TYPE_PAGE_CACHE == VM_PAGE_CACHE);
+
+	ring = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, TRACE_PAGES);
+	ring_head = ring_tail = 0;
+}
+
+/* Records an event of type KIND at user address VA, on PAGE if not null,
+ * that started at timer tick START.  FLAGS are VMTRACE_* flags.  The
+ * event is charged to PAGE's owner, or to the running thread if PAGE is
+ * null.  Safe to call from any thread. */
+void
+vm_trace (enum vmtrace_kind kind, struct page *page, const void *va,
+		int flags, int64_t start) {
+	int64_t now = timer_ticks ();
+	struct vmtrace_rec *rec;
+	enum intr_level old_level;
+
+	old_level = intr_disable ();
+	if (ring_head - ring_tail == TRACE_CNT)
+		ring_tail++;
+	rec = &ring[ring_head++ % TRACE_CNT];
+	rec->va = (uint64_t) pg_round_down (va);
+	rec->time = now;
+	rec->cost = now - start;
+	rec->tid = page != NULL ? page->owner->tid : thread_current ()->tid;
+	rec->kind = kind;
+	rec->type = page != NULL ? page_get_type (page) : VMTRACE_TYPE_NONE;
+	rec->flags = flags;
+	intr_set_level (old_level);
+}
+
+/* Moves up to MAX of the oldest records into BUF, which may be user
+ * memory, and returns the number moved. */
+size_t
+vm_trace_drain (struct vmtrace_rec *buf, size_t max) {
+	struct vmtrace_rec chunk[16];
+	size_t moved = 0;
+
+	while (moved < max) {
+		enum intr_level old_level;
+		size_t cnt = 0;
+
+		/* Take records with interrupts off, but copy them out with
+		 * interrupts on: writing BUF may fault. */
+		old_level = intr_disable ();
+		while (cnt < sizeof chunk / sizeof *chunk && moved + cnt < max
+				&& ring_tail != ring_head)
+			chunk[cnt++] = ring[ring_tail++ % TRACE_CNT];
+		intr_set_level (old_level);
+
+		if (cnt == 0)
+			break;
+		memcpy (buf + moved, chunk, cnt * sizeof *chunk);
+		moved += cnt;
+	}
+	return moved;
+}
@@ -1,8 +1,45 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/trace.h"
+#include "devices/timer.h"
+
+/* Free user frame watermarks, in pages.  See vm.h. */
+size_t vm_wmark_low;
+size_t vm_wmark_high;
+
+/* User stack limits, in pages.  See vm.h. */
+size_t vm_stack_limit = 256;
+size_t vm_stack_gap = 1;
+
+/* Number of stack pages mapped by one stack growth fault: the faulting
+ * page and the ones right below it, which a growing stack touches
+ * next. */
+#define STACK_GROW_PAGES 4
+
+/* Maximum number of frames the swap daemon evicts per pass.  The
+ * victims are unmapped together and then written out one after another,
+ * to consecutive slots of the current swap cluster. */
+#define KSWAPD_BATCH 16
+
+/* All frames that currently back a user page, in clock order. */
+static struct list frame_table;
+static struct list_elem *clock_hand;    /* Next frame the clock looks at. */
+static struct lock frame_lock;          /* Protects frames and page links. */
+static struct condition frame_unpinned; /* Signaled when a frame is unpinned. */
+
+/* Swap daemon. */
+static struct semaphore kswapd_wakeup;  /* Up'd to start a reclaim pass. */
+static struct lock kswapd_lock;         /* Protects kswapd_awake. */
+static bool kswapd_awake;               /* True if a pass is pending. */
+static void kswapd (void *aux);
+static void kswapd_wake (void);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +52,25 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	size_t user_frames = palloc_user_free_cnt ();
+
+	vm_trace_init ();
+
+	list_init (&frame_table);
+	clock_hand = NULL;
+	lock_init (&frame_lock);
+	cond_init (&frame_unpinned);
+
+	if (vm_wmark_low == 0)
+		vm_wmark_low = user_frames / 64 + 1;
+	if (vm_wmark_high < vm_wmark_low)
+		vm_wmark_high = vm_wmark_low * 2;
+
+	sema_init (&kswapd_wakeup, 0);
+	lock_init (&kswapd_lock);
+	kswapd_awake = false;
+	if (thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR)
+		PANIC ("vm: cannot start kswapd");
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,13 +88,19 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (bool *busy);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static struct frame *frame_table_add (void *kva);
+static void frame_table_remove (struct frame *frame);
+static void frame_discard (struct frame *frame);
+static void vm_free_frame (struct page *page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
- * `vm_alloc_page`. */
+ * `vm_alloc_page`.
+ * AUX, if not null, must come from malloc(); INIT takes ownership of it,
+ * and the page frees it if it is destroyed before INIT ever runs. */
 bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
@@ -50,11 +111,32 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
-
-		/* TODO: Insert the page into the spt. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->owner = thread_current ();
+		page->writable = writable;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
@@ -62,82 +144,432 @@ err:
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page p;
+	struct hash_elem *e;
 
-	return page;
+	p.va = pg_round_down (va);
+	e = hash_find (&spt->pages, &p.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
-
-	return succ;
+spt_insert_page (struct supplemental_page_table *spt,
+		struct page *page) {
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	hash_delete (&spt->pages, &page->spt_elem);
+	vm_free_frame (page);
 	vm_dealloc_page (page);
-	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted.
+ * Runs the clock over the frame table, giving recently accessed pages a
+ * second chance.  The victim is pinned and unmapped from its owner before
+ * it is returned, so the owner faults (and waits) if it touches the page
+ * while it is being written out.  Returns NULL if every frame is pinned,
+ * setting *BUSY if that is only temporary.  FRAME_LOCK must be held. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-
-	return victim;
+vm_get_victim (bool *busy) {
+	size_t scan_cnt = 2 * list_size (&frame_table);
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	*busy = false;
+	while (scan_cnt-- > 0) {
+		struct frame *frame;
+		struct page *page;
+
+		if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+			clock_hand = list_begin (&frame_table);
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+
+		if (frame->pinned) {
+			*busy = true;
+			continue;
+		}
+
+		page = frame->page;
+		if (pml4_is_accessed (page->owner->pml4, page->va)) {
+			pml4_set_accessed (page->owner->pml4, page->va, false);
+			continue;
+		}
+
+		frame->pinned = true;
+		pml4_clear_page (page->owner->pml4, page->va);
+		return frame;
+	}
+	return NULL;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * The returned frame is still pinned and in the frame table.
+ * Return NULL if no frame could be evicted right now; the caller should
+ * retry, since a frame may have been returned to the user pool. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victim;
+	int64_t start;
+	bool busy;
+
+	lock_acquire (&frame_lock);
+	victim = vm_get_victim (&busy);
+	if (victim == NULL && busy)
+		cond_wait (&frame_unpinned, &frame_lock);
+	lock_release (&frame_lock);
+
+	if (victim == NULL) {
+		if (!busy)
+			PANIC ("vm: no user frame can be evicted");
+		return NULL;
+	}
 
-	return NULL;
+	start = timer_ticks ();
+	if (!swap_out (victim->page))
+		PANIC ("vm: swap space exhausted");
+	vm_trace (VMTRACE_EVICT, victim->page, victim->page->va, 0, start);
+
+	lock_acquire (&frame_lock);
+	victim->page->frame = NULL;
+	victim->page = NULL;
+	lock_release (&frame_lock);
+	return victim;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * The frame is returned pinned; unpin it once the page is mapped. */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+
+	while (frame == NULL) {
+		void *kva = palloc_get_page (PAL_USER);
+
+		if (kva != NULL) {
+			frame = frame_table_add (kva);
+			if (frame == NULL)
+				PANIC ("vm: out of kernel memory for frame table");
+		} else
+			frame = vm_evict_frame ();
+	}
+
+	if (palloc_user_free_cnt () < vm_wmark_low)
+		kswapd_wake ();
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Takes a free user frame for PAGE without evicting anything, for
+ * readahead.  Returns NULL if PAGE is already resident or if that would
+ * drop the free user frames to the low watermark.  The frame is returned
+ * pinned and linked to PAGE; fill it in, then call vm_map_frame(). */
+struct frame *
+vm_prefetch_frame (struct page *page) {
+	struct frame *frame;
+	void *kva;
+
+	if (palloc_user_free_cnt () <= vm_wmark_low)
+		return NULL;
+	kva = palloc_get_page (PAL_USER);
+	if (kva == NULL)
+		return NULL;
+	frame = frame_table_add (kva);
+	if (frame == NULL) {
+		palloc_free_page (kva);
+		return NULL;
+	}
+
+	/* The page may still be on its way out to swap. */
+	lock_acquire (&frame_lock);
+	if (page->frame == NULL) {
+		frame->page = page;
+		page->frame = frame;
+	}
+	lock_release (&frame_lock);
+	if (frame->page == NULL) {
+		frame_discard (frame);
+		return NULL;
+	}
+	return frame;
+}
+
+/* Maps PAGE's pinned frame into its owner's page table and unpins it.
+ * On failure the frame is returned to the user pool. */
+bool
+vm_map_frame (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (frame != NULL && frame->pinned);
+
+	if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable)) {
+		frame_discard (frame);
+		return false;
+	}
+
+	lock_acquire (&frame_lock);
+	frame->pinned = false;
+	cond_broadcast (&frame_unpinned, &frame_lock);
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Wraps user page KVA in a new pinned frame and adds it to the frame
+ * table.  Returns NULL if out of kernel memory. */
+static struct frame *
+frame_table_add (void *kva) {
+	struct frame *frame = malloc (sizeof *frame);
+
+	if (frame == NULL)
+		return NULL;
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->pinned = true;
+
+	lock_acquire (&frame_lock);
+	list_push_back (&frame_table, &frame->elem);
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Unlinks pinned FRAME from its page and returns it to the user pool. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+frame_discard (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame_table_remove (frame);
+	if (frame->page != NULL)
+		frame->page->frame = NULL;
+	lock_release (&frame_lock);
+	palloc_free_page (frame->kva);
+	free (frame);
 }
 
-/* Handle the fault on write_protected page */
+/* Removes FRAME from the frame table, keeping the clock hand valid.
+ * FRAME_LOCK must be held. */
+static void
+frame_table_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+}
+
+/* Unmaps PAGE and returns its frame, if any, to the user pool.
+ * Waits for an eviction of PAGE that is in flight to finish first. */
+static void
+vm_free_frame (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait (&frame_unpinned, &frame_lock);
+	frame = page->frame;
+	if (frame != NULL) {
+		frame_table_remove (frame);
+		page->frame = NULL;
+		if (page->owner->pml4 != NULL)
+			pml4_clear_page (page->owner->pml4, page->va);
+	}
+	lock_release (&frame_lock);
+
+	if (frame != NULL) {
+		palloc_free_page (frame->kva);
+		free (frame);
+	}
+}
+
+/* Wakes the swap daemon unless a pass is already pending. */
+static void
+kswapd_wake (void) {
+	lock_acquire (&kswapd_lock);
+	if (!kswapd_awake) {
+		kswapd_awake = true;
+		sema_up (&kswapd_wakeup);
+	}
+	lock_release (&kswapd_lock);
+}
+
+/* Evicts up to WANT frames and returns them to the user pool: picks and
+ * unmaps them as one batch under FRAME_LOCK, then writes them out one
+ * at a time without it.  Returns the number of frames freed. */
+static size_t
+kswapd_reclaim (size_t want) {
+	struct frame *batch[KSWAPD_BATCH];
+	bool written[KSWAPD_BATCH];
+	int64_t start;
+	size_t cnt = 0, freed = 0, i;
+	bool busy;
+
+	/* Pick and unmap the whole batch first... */
+	lock_acquire (&frame_lock);
+	while (cnt < want && cnt < KSWAPD_BATCH) {
+		struct frame *victim = vm_get_victim (&busy);
+		if (victim == NULL)
+			break;
+		batch[cnt++] = victim;
+	}
+	lock_release (&frame_lock);
+
+	/* ...then write it out without holding the lock, so that faults on
+	 * other pages are not stuck behind the swap disk. */
+	for (i = 0; i < cnt; i++) {
+		start = timer_ticks ();
+		written[i] = swap_out (batch[i]->page);
+		if (written[i])
+			vm_trace (VMTRACE_EVICT, batch[i]->page, batch[i]->page->va,
+					VMTRACE_KSWAPD, start);
+	}
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = batch[i];
+		struct page *page = frame->page;
+
+		if (written[i]) {
+			page->frame = NULL;
+			frame_table_remove (frame);
+			palloc_free_page (frame->kva);
+			free (frame);
+			freed++;
+		} else {
+			/* No swap space left: hand the page back to its owner. */
+			pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					page->writable);
+			frame->pinned = false;
+		}
+	}
+	cond_broadcast (&frame_unpinned, &frame_lock);
+	lock_release (&frame_lock);
+	return freed;
+}
+
+/* Swap daemon.  Sleeps until free user frames drop below the low
+ * watermark, then evicts in batches until the high watermark is reached,
+ * so that page faults rarely have to evict synchronously. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		size_t free_cnt;
+
+		sema_down (&kswapd_wakeup);
+
+		/* A wake from here on starts another pass, so none is lost
+		 * between the last check below and going back to sleep. */
+		lock_acquire (&kswapd_lock);
+		kswapd_awake = false;
+		lock_release (&kswapd_lock);
+
+		while ((free_cnt = palloc_user_free_cnt ()) < vm_wmark_high)
+			if (kswapd_reclaim (vm_wmark_high - free_cnt) == 0)
+				break;
+	}
+}
+
+/* Returns true if any page of the current process lies in
+ * [LO, HI). */
+static bool
+spt_range_used (uint8_t *lo, uint8_t *hi) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (; lo < hi; lo += PGSIZE)
+		if (spt_find_page (spt, lo) != NULL)
+			return true;
+	return false;
+}
+
+/* Growing the stack.
+ * Grows the stack of the current process down to cover ADDR, if that
+ * looks like a stack access from a thread whose stack pointer is RSP,
+ * and maps ADDR's page along with up to STACK_GROW_PAGES - 1 pages below
+ * it.  Pages between ADDR and the old bottom of the stack are added too,
+ * but only mapped when touched, keeping the stack one contiguous range.
+ * Returns true if ADDR's page was mapped. */
+static bool
+vm_stack_growth (void *addr, void *rsp) {
+	struct thread *curr = thread_current ();
+	uint8_t *old_bottom = curr->stack_bottom;
+	uint8_t *limit = (uint8_t *) USER_STACK - vm_stack_limit * PGSIZE;
+	uint8_t *upage = pg_round_down (addr);
+	uint8_t *bottom, *p;
+
+	/* PUSH faults 8 bytes below the stack pointer. */
+	if (old_bottom == NULL || (uint8_t *) addr < (uint8_t *) rsp - 8
+			|| upage >= old_bottom || upage < limit)
+		return false;
+
+	/* Map a few pages ahead of the fault, unless that would come too
+	 * close to another mapping. */
+	bottom = upage - (STACK_GROW_PAGES - 1) * PGSIZE;
+	if (bottom < limit || bottom > upage)
+		bottom = limit;
+	if (spt_range_used (bottom - vm_stack_gap * PGSIZE, old_bottom))
+		bottom = upage;
+	if (spt_range_used (bottom - vm_stack_gap * PGSIZE, old_bottom))
+		return false;
+
+	for (p = old_bottom - PGSIZE; p >= bottom; p -= PGSIZE) {
+		if (!vm_alloc_page (VM_ANON | VM_STACK, p, true))
+			return false;
+		curr->stack_bottom = p;
+	}
+
+	for (p = bottom; p < upage; p += PGSIZE)
+		vm_claim_page (p);
+	return vm_claim_page (upage);
+}
+
+/* Grows the stack of the current process to cover ADDR on behalf of a
+ * system call that is about to access it, as a fault on ADDR would.
+ * Returns true if ADDR's page is now part of the stack. */
+bool
+vm_grow_stack (void *addr) {
+	return vm_stack_growth (addr, thread_current ()->user_rsp);
+}
+
+/* Handle the fault on write_protected page.  Pages are never shared
+ * copy-on-write, so such a fault is always a real protection error. */
 static bool
 vm_handle_wp (struct page *page UNUSED) {
+	return false;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+	int64_t start = timer_ticks ();
+	bool success = false;
+
+	/* Validate the fault */
+	if (addr != NULL && is_user_vaddr (addr) && not_present) {
+		page = spt_find_page (spt, addr);
+		if (page != NULL) {
+			if (!write || page->writable)
+				success = vm_do_claim_page (page);
+		} else {
+			/* During a system call, F holds the kernel's rsp. */
+			void *rsp = user ? (void *) f->rsp : thread_current ()->user_rsp;
+			success = vm_stack_growth (addr, rsp);
+			page = spt_find_page (spt, addr);
+		}
+	}
 
-	return vm_do_claim_page (page);
+	vm_trace (VMTRACE_FAULT, page, addr,
+			(write ? VMTRACE_WRITE : 0) | (success ? 0 : VMTRACE_FAILED), start);
+	return success;
 }
 
 /* Free the page.
@@ -150,41 +582,160 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+	bool resident;
+
+	/* The page may be on its way out to swap; wait until it is gone. */
+	lock_acquire (&frame_lock);
+	while (page->frame != NULL && page->frame->pinned)
+		cond_wait (&frame_unpinned, &frame_lock);
+	resident = page->frame != NULL;
+	lock_release (&frame_lock);
+	if (resident)
+		return true;
+
+	frame = vm_get_frame ();
 
 	/* Set links */
 	frame->page = page;
 	page->frame = frame;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	if (!swap_in (page, frame->kva)) {
+		frame_discard (frame);
+		return false;
+	}
+
+	/* Insert page table entry to map page's VA to frame's PA. */
+	return vm_map_frame (page);
+}
+
+/* Claims PAGE and pins its frame, so that it stays resident until
+ * vm_unpin_frame() is called.  Returns the frame, or NULL if PAGE could
+ * not be brought in. */
+static struct frame *
+vm_pin_page (struct page *page) {
+	for (;;) {
+		struct frame *frame;
+
+		if (!vm_do_claim_page (page))
+			return NULL;
+
+		/* It may have been picked for eviction again meanwhile. */
+		lock_acquire (&frame_lock);
+		while (page->frame != NULL && page->frame->pinned)
+			cond_wait (&frame_unpinned, &frame_lock);
+		frame = page->frame;
+		if (frame != NULL)
+			frame->pinned = true;
+		lock_release (&frame_lock);
+		if (frame != NULL)
+			return frame;
+	}
+}
+
+/* Unpins FRAME, pinned by vm_pin_page(). */
+static void
+vm_unpin_frame (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame->pinned = false;
+	cond_broadcast (&frame_unpinned, &frame_lock);
+	lock_release (&frame_lock);
+}
 
-	return swap_in (page, frame->kva);
+/* Returns a hash value for page P. */
+static uint64_t
+page_hash (const struct hash_elem *p_, void *aux UNUSED) {
+	const struct page *p = hash_entry (p_, struct page, spt_elem);
+	return hash_bytes (&p->va, sizeof p->va);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page *a = hash_entry (a_, struct page, spt_elem);
+	const struct page *b = hash_entry (b_, struct page, spt_elem);
+	return a->va < b->va;
+}
+
+/* Releases the page in hash element E, for hash_clear(). */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	struct page *page = hash_entry (e, struct page, spt_elem);
+
+	vm_free_frame (page);
+	vm_dealloc_page (page);
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	if (!hash_init (&spt->pages, page_hash, page_less, NULL))
+		PANIC ("vm: cannot allocate supplemental page table");
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst.
+ * DST must belong to the running thread.  A page that was never touched
+ * and has no initializer is copied as it is.  Any other page is brought
+ * into memory in SRC and its contents copied into a new anonymous page
+ * of DST, since an initializer's AUX can be neither shared nor copied
+ * without knowing what it holds.  File-backed pages are not supported.
+ * Returns false on failure; DST then holds the pages copied so far, for
+ * supplemental_page_table_kill(). */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+
+	ASSERT (dst == &thread_current ()->spt);
+
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *src_page = hash_entry (hash_cur (&i), struct page,
+				spt_elem);
+		struct frame *src_frame, *dst_frame;
+
+		if (page_get_type (src_page) != VM_ANON)
+			return false;
+
+		if (VM_TYPE (src_page->operations->type) == VM_UNINIT
+				&& src_page->uninit.init == NULL) {
+			if (!vm_alloc_page (src_page->uninit.type, src_page->va,
+						src_page->writable))
+				return false;
+			continue;
+		}
+
+		if (!vm_alloc_page (VM_ANON, src_page->va, src_page->writable))
+			return false;
+		dst_frame = vm_pin_page (spt_find_page (dst, src_page->va));
+		if (dst_frame == NULL)
+			return false;
+		src_frame = vm_pin_page (src_page);
+		if (src_frame == NULL) {
+			vm_unpin_frame (dst_frame);
+			return false;
+		}
+		memcpy (dst_frame->kva, src_frame->kva, PGSIZE);
+		vm_unpin_frame (src_frame);
+		vm_unpin_frame (dst_frame);
+	}
+	return true;
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	hash_clear (&spt->pages, page_destructor);
 }
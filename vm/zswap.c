@@ -0,0 +1,276 @@
+/* zswap.c: Compressed in-memory cache in front of the swap disk. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+size_t zswap_budget;
+
+/* A compressed page. */
+struct zswap_entry {
+	size_t len;                 /* Bytes of compressed data. */
+	uint8_t data[];             /* Compressed data. */
+};
+
+/* Largest entry worth keeping.  Bigger entries land in malloc()'s
+ * half-page blocks, one per page, and save nothing. */
+#define ZSWAP_MAX_ENTRY (PGSIZE / 4)
+#define ZSWAP_MAX_LEN (ZSWAP_MAX_ENTRY - sizeof (struct zswap_entry))
+
+/* Compressor match finder: a hash table from 4-byte sequences to the
+ * position they were last seen at, plus one. */
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+static uint8_t lz_buf[ZSWAP_MAX_LEN];
+
+static struct lock zswap_lock;      /* Protects everything below, too. */
+static size_t pool_bytes;           /* Compressed bytes in the pool. */
+static size_t pool_pages;           /* Pages held in the pool. */
+
+/* Statistics. */
+static long long store_cnt;         /* Pages compressed into the pool. */
+static long long store_bytes;       /* Compressed bytes of those pages. */
+static long long reject_cnt;        /* Pages that did not compress well. */
+static long long spill_cnt;         /* Pages turned away, pool full. */
+static long long hit_cnt;           /* Swap-ins served from the pool. */
+static long long miss_cnt;          /* Swap-ins that went to disk. */
+
+static size_t lz_compress (const uint8_t *src, size_t len,
+		uint8_t *dst, size_t cap);
+static bool lz_decompress (const uint8_t *src, size_t len,
+		uint8_t *dst, size_t cap);
+
+/* Initializes the compressed pool. */
+void
+zswap_init (void) {
+	lock_init (&zswap_lock);
+}
+
+/* Compresses the page at KVA into the pool.  Returns the new entry, or
+ * a null pointer if the tier is disabled, the page does not compress
+ * well, or the pool is over budget; the page then goes to disk. */
+struct zswap_entry *
+zswap_store (const void *kva) {
+	struct zswap_entry *entry = NULL;
+	size_t len;
+
+	if (zswap_budget == 0)
+		return NULL;
+
+	lock_acquire (&zswap_lock);
+	len = lz_compress (kva, PGSIZE, lz_buf, sizeof lz_buf);
+	if (len == 0)
+		reject_cnt++;
+	else if (pool_bytes + len > zswap_budget * PGSIZE)
+		spill_cnt++;
+	else {
+		entry = malloc (sizeof *entry + len);
+		if (entry != NULL) {
+			entry->len = len;
+			memcpy (entry->data, lz_buf, len);
+			pool_bytes += len;
+			pool_pages++;
+			store_cnt++;
+			store_bytes += len;
+		} else
+			spill_cnt++;
+	}
+	lock_release (&zswap_lock);
+	return entry;
+}
+
+/* Decompresses ENTRY into the page at KVA and frees it.  Returns false,
+ * counting a swap-in from disk, if ENTRY is a null pointer. */
+bool
+zswap_load (struct zswap_entry *entry, void *kva) {
+	if (entry == NULL) {
+		lock_acquire (&zswap_lock);
+		miss_cnt++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+
+	if (!lz_decompress (entry->data, entry->len, kva, PGSIZE))
+		PANIC ("zswap: corrupt compressed page");
+
+	lock_acquire (&zswap_lock);
+	hit_cnt++;
+	lock_release (&zswap_lock);
+	zswap_free (entry);
+	return true;
+}
+
+/* Frees ENTRY, which may be a null pointer. */
+void
+zswap_free (struct zswap_entry *entry) {
+	if (entry == NULL)
+		return;
+
+	lock_acquire (&zswap_lock);
+	pool_bytes -= entry->len;
+	pool_pages--;
+	lock_release (&zswap_lock);
+	free (entry);
+}
+
+/* Prints zswap statistics. */
+void
+zswap_print_stats (void) {
+	long long ratio;
+
+	if (zswap_budget == 0)
+		return;
+	ratio = store_bytes > 0 ? store_cnt * PGSIZE * 100 / store_bytes : 0;
+	printf ("zswap: %lld stores (ratio %lld.%02lld), %lld rejected, "
+			"%lld spilled, %zu pages in %zu bytes\n",
+			store_cnt, ratio / 100, ratio % 100, reject_cnt, spill_cnt,
+			pool_pages, pool_bytes);
+	printf ("zswap: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
+
+/* Appends length extension bytes for N to *OP. */
+static uint8_t *
+lz_put_length (uint8_t *op, size_t n) {
+	for (; n >= 255; n -= 255)
+		*op++ = 255;
+	*op++ = n;
+	return op;
+}
+
+/* Appends a sequence to DST: the LIT_LEN literal bytes at LIT, followed by
+ * a MATCH_LEN byte copy from OFFSET bytes back, if MATCH_LEN is nonzero.
+ * Returns the new end of output, or a null pointer if it would pass END.
+ *
+ * A sequence is a token byte holding the literal count in its upper
+ * nibble and the match length minus LZ_MIN_MATCH in its lower one; a
+ * nibble of 15 is continued by extension bytes, each added to it, the
+ * last of which is below 255.  The literals and then a 2-byte
+ * little-endian offset follow.  The final sequence has no match. */
+static uint8_t *
+lz_put_sequence (uint8_t *op, uint8_t *end, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t ml = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+	if ((size_t) (end - op) < 1 + lit_len / 255 + 1 + lit_len + 2
+			+ ml / 255 + 1)
+		return NULL;
+
+	*op++ = ((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15);
+	if (lit_len >= 15)
+		op = lz_put_length (op, lit_len - 15);
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+
+	if (match_len > 0) {
+		*op++ = offset & 0xff;
+		*op++ = offset >> 8;
+		if (ml >= 15)
+			op = lz_put_length (op, ml - 15);
+	}
+	return op;
+}
+
+/* Reads 4 bytes at P. */
+static inline uint32_t
+lz_read32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Compresses the LEN bytes at SRC into at most CAP bytes at DST, with a
+ * greedy LZ77 in the style of LZ4.  Returns the compressed length, or 0
+ * if it does not fit.  LEN must be below 64 kB. */
+static size_t
+lz_compress (const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+	uint8_t *op = dst, *end = dst + cap;
+	size_t ip = 0, anchor = 0;
+
+	ASSERT (len < 65536);
+
+	memset (lz_table, 0, sizeof lz_table);
+	while (ip + LZ_MIN_MATCH <= len) {
+		uint32_t seq = lz_read32 (src + ip);
+		size_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t ref = lz_table[h];
+		size_t match_len;
+
+		lz_table[h] = ip + 1;
+		if (ref == 0 || lz_read32 (src + --ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		match_len = LZ_MIN_MATCH;
+		while (ip + match_len < len && src[ref + match_len] == src[ip + match_len])
+			match_len++;
+		op = lz_put_sequence (op, end, src + anchor, ip - anchor, ip - ref,
+				match_len);
+		if (op == NULL)
+			return 0;
+		ip += match_len;
+		anchor = ip;
+	}
+
+	op = lz_put_sequence (op, end, src + anchor, len - anchor, 0, 0);
+	return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads a length extension from SRC[*IP], adding it to *N.  Returns
+ * false if it runs past LEN. */
+static bool
+lz_get_length (const uint8_t *src, size_t len, size_t *ip, size_t *n) {
+	uint8_t b;
+
+	do {
+		if (*ip >= len)
+			return false;
+		b = src[(*ip)++];
+		*n += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses the LEN bytes at SRC, made by lz_compress(), into exactly
+ * CAP bytes at DST.  Returns false if the data is malformed. */
+static bool
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+	size_t ip = 0, op = 0;
+
+	while (ip < len) {
+		uint8_t token = src[ip++];
+		size_t lit_len = token >> 4, match_len = token & 15, offset;
+
+		if (lit_len == 15 && !lz_get_length (src, len, &ip, &lit_len))
+			return false;
+		if (lit_len > len - ip || lit_len > cap - op)
+			return false;
+		memcpy (dst + op, src + ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (ip == len)
+			break;
+
+		if (len - ip < 2)
+			return false;
+		offset = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		if (match_len == 15 && !lz_get_length (src, len, &ip, &match_len))
+			return false;
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || match_len > cap - op)
+			return false;
+
+		/* Byte by byte: the match may overlap its own output. */
+		for (; match_len > 0; match_len--, op++)
+			dst[op] = dst[op - offset];
+	}
+	return op == cap;
+}